@@ -7,6 +7,11 @@ CC=clang
 SRC_DIR=src
 EXT_DIR=dep
 
+SOURCES="${SRC_DIR}/main.cpp ${SRC_DIR}/bench.cpp ${SRC_DIR}/cdlod.cpp ${SRC_DIR}/clipmap.cpp ${SRC_DIR}/cubemap_loader.cpp ${SRC_DIR}/frame_ring.cpp ${SRC_DIR}/gpu_cull.cpp ${SRC_DIR}/gpu_profiler.cpp ${SRC_DIR}/height_kernels.cpp ${SRC_DIR}/height_pyramid.cpp ${SRC_DIR}/hiz.cpp ${SRC_DIR}/job_system.cpp ${SRC_DIR}/normal_map.cpp ${SRC_DIR}/quadtree.cpp ${SRC_DIR}/roughness.cpp ${SRC_DIR}/shader.cpp ${SRC_DIR}/terrain.cpp ${SRC_DIR}/terrain_asset.cpp ${SRC_DIR}/terrain_data.cpp ${SRC_DIR}/tess_edges.cpp ${SRC_DIR}/texture_cache.cpp ${SRC_DIR}/texture_codec.cpp ${SRC_DIR}/texture_layout.cpp ${SRC_DIR}/virtual_heightmap.cpp"
+
+# the offline terrain-bake tool shares the bake half of the renderer
+BAKE_SOURCES="${SRC_DIR}/terrain_bake.cpp ${SRC_DIR}/height_kernels.cpp ${SRC_DIR}/height_pyramid.cpp ${SRC_DIR}/job_system.cpp ${SRC_DIR}/normal_map.cpp ${SRC_DIR}/roughness.cpp ${SRC_DIR}/terrain_asset.cpp ${SRC_DIR}/terrain_data.cpp ${SRC_DIR}/texture_cache.cpp ${SRC_DIR}/texture_codec.cpp ${SRC_DIR}/texture_layout.cpp ${SRC_DIR}/virtual_heightmap.cpp"
+
 INCLUDES="-I${EXT_DIR}/glad/include -I${EXT_DIR}/glfw/include -I${EXT_DIR}/stb/ -I${EXT_DIR}/"
 LIBS="-lglfw -ldl -lassimp -lm -lpthread -lX11 -lXrandr -lXi -lXxf86vm -lXcursor -lGL"
 
@@ -19,9 +24,18 @@ $CC -std=c11 \
 echo "Compiling project (C++)..."
 $CXX -std=c++20 \
     $INCLUDES \
-    $SRC_DIR/main.cpp \
+    $SOURCES \
     glad.o \
     $LIBS \
     -o aincrad
-prime-run ./aincrad
+
+echo "Compiling terrain-bake (C++)..."
+$CXX -std=c++20 \
+    $INCLUDES \
+    $BAKE_SOURCES \
+    glad.o \
+    -ldl -lpthread \
+    -o terrain-bake
+
+prime-run ./aincrad "$@"
 rm aincrad
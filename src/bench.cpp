@@ -0,0 +1,135 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static void printBenchUsage(const char* argv0)
+{
+    std::cout << "usage: " << argv0 << " [--bench [frames]] [--bench-out <file.csv|file.json>]" << std::endl;
+}
+
+bool parseBenchArgs(int argc, char** argv, BenchOptions& opts)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--bench") == 0)
+        {
+            opts.enabled = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                char* end;
+                long n = std::strtol(argv[++i], &end, 10);
+                if (*end != '\0' || n <= 0 || n > 1000000000) {
+                    printBenchUsage(argv[0]);
+                    return false;
+                }
+                opts.frames = (unsigned)n;
+            }
+        }
+        else if (std::strcmp(argv[i], "--bench-out") == 0)
+        {
+            if (i + 1 >= argc) {
+                printBenchUsage(argv[0]);
+                return false;
+            }
+            opts.outPath = argv[++i];
+        }
+    }
+    return true;
+}
+
+void benchCameraAt(unsigned frame, unsigned frames, float width, float height,
+                   glm::vec3& pos, glm::vec3& front)
+{
+    // One lap of an ellipse over the map, bobbing between high overview and
+    // low ridge-skimming altitude so both near and far LODs get exercised.
+    float t = frames > 1 ? frame / (float)frames : 0.0f;
+    float a = t * 2.0f * 3.14159265f;
+
+    float rx = width * 0.3f;
+    float rz = height * 0.3f;
+    pos = glm::vec3(rx * std::cos(a), 70.0f + 50.0f * std::sin(3.0f * a), rz * std::sin(a));
+
+    // look along the tangent, pitched slightly down towards the terrain
+    glm::vec3 tangent(-rx * std::sin(a), 0.0f, rz * std::cos(a));
+    front = glm::normalize(glm::normalize(tangent) + glm::vec3(0.0f, -0.25f, 0.0f));
+}
+
+struct BenchStat {
+    double avg, min, max, p95;
+};
+
+static BenchStat benchStat(std::vector<double> v)
+{
+    BenchStat s = {0.0, 0.0, 0.0, 0.0};
+    if (v.empty())
+        return s;
+    std::sort(v.begin(), v.end());
+    for (double x : v)
+        s.avg += x;
+    s.avg /= v.size();
+    s.min = v.front();
+    s.max = v.back();
+    s.p95 = v[std::min(v.size() - 1, (size_t)(v.size() * 0.95))];
+    return s;
+}
+
+bool writeBenchResults(const std::string& path, const std::vector<BenchFrame>& frames)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cout << "Failed to open benchmark output: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<double> cpu, gpu, wall;
+    unsigned long long prims = 0;
+    for (const BenchFrame& f : frames)
+    {
+        cpu.push_back(f.cpuMs);
+        gpu.push_back(f.gpuMs);
+        wall.push_back(f.frameMs);
+        prims += f.primitives;
+    }
+    BenchStat c = benchStat(cpu), g = benchStat(gpu), w = benchStat(wall);
+    double avgPrims = frames.empty() ? 0.0 : prims / (double)frames.size();
+
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (json)
+    {
+        out << "{\n  \"frames\": [\n";
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            const BenchFrame& f = frames[i];
+            out << "    {\"frame\": " << f.frame
+                << ", \"cpu_ms\": " << f.cpuMs
+                << ", \"frame_ms\": " << f.frameMs
+                << ", \"gpu_ms\": " << f.gpuMs
+                << ", \"primitives\": " << f.primitives << "}"
+                << (i + 1 < frames.size() ? ",\n" : "\n");
+        }
+        out << "  ],\n  \"summary\": {"
+            << "\"cpu_ms_avg\": " << c.avg << ", \"cpu_ms_p95\": " << c.p95
+            << ", \"gpu_ms_avg\": " << g.avg << ", \"gpu_ms_p95\": " << g.p95
+            << ", \"frame_ms_avg\": " << w.avg
+            << ", \"primitives_avg\": " << avgPrims << "}\n}\n";
+    }
+    else
+    {
+        out << "frame,cpu_ms,frame_ms,gpu_ms,primitives\n";
+        for (const BenchFrame& f : frames)
+            out << f.frame << "," << f.cpuMs << "," << f.frameMs << "," << f.gpuMs << "," << f.primitives << "\n";
+    }
+
+    std::cout << "Benchmark: " << frames.size() << " frames -> " << path << std::endl;
+    std::cout << "  cpu   avg " << c.avg << " ms  min " << c.min << "  max " << c.max << "  p95 " << c.p95 << std::endl;
+    std::cout << "  gpu   avg " << g.avg << " ms  min " << g.min << "  max " << g.max << "  p95 " << g.p95 << std::endl;
+    std::cout << "  frame avg " << w.avg << " ms" << std::endl;
+    std::cout << "  primitives avg " << avgPrims << std::endl;
+    return true;
+}
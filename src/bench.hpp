@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Headless benchmark: replays a scripted flythrough over the heightmap for a
+// fixed number of frames and records per-frame timings.
+struct BenchOptions {
+  bool enabled = false;
+  unsigned frames = 600;
+  unsigned warmup = 2;          // rendered before recording starts
+  std::string outPath = "bench.csv";
+};
+
+struct BenchFrame {
+  unsigned frame;
+  double cpuMs;                 // time spent issuing the frame on the main thread
+  double frameMs;               // wall time from frame start to frame start
+  double gpuMs;                 // sum of the GpuProfiler passes of the frame
+  unsigned long long primitives; // likewise for GL_PRIMITIVES_GENERATED
+};
+
+// Recognises --bench [frames] and --bench-out <path>. Returns false on bad
+// arguments after printing usage.
+bool parseBenchArgs(int argc, char** argv, BenchOptions& opts);
+
+// Deterministic camera path for frame `frame` of `frames` over a terrain of
+// `width` x `height` texels centred on the origin.
+void benchCameraAt(unsigned frame, unsigned frames, float width, float height,
+                   glm::vec3& pos, glm::vec3& front);
+
+// Writes CSV, or JSON when the path ends in ".json", and prints a summary.
+bool writeBenchResults(const std::string& path, const std::vector<BenchFrame>& frames);
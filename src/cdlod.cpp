@@ -0,0 +1,116 @@
+#include "cdlod.hpp"
+
+#include "frame_ring.hpp"
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+const char* CDLOD_VS = R"(
+layout (location = 0) in uvec2 aGrid; // vertex of the node grid
+layout (location = 1) in vec4 aNode;  // u0, v0, size in texture space
+
+uniform vec2 terrainSize;
+uniform float cdlodGrid;
+uniform float lodRange;
+uniform float groundAltitude; // camera height above the tallest node
+
+out vec3 WorldPos;
+out vec2 TexCoord;
+out float Height;
+
+void main(){
+  vec2 cell = vec2(aGrid);
+  vec2 xz = terrainSize * (aNode.xy + cell / cdlodGrid * aNode.z - 0.5);
+
+  // ground distance, as the quadtree measured it; odd vertices slide onto
+  // their even neighbours until the node is its parent's grid
+  float extent = aNode.z * max(terrainSize.x, terrainSize.y);
+  float distance = length(vec3(xz - cameraPos.xz, groundAltitude));
+  float morph = clamp((distance - (lodRange + 1.5) * extent) / ((lodRange - 1.5) * extent), 0.0, 1.0);
+  cell -= fract(cell * 0.5) * 2.0 * morph;
+
+  vec2 uv = aNode.xy + cell / cdlodGrid * aNode.z;
+  xz = terrainSize * (uv - 0.5);
+  Height = terrainHeight(uv) * 64.0 - 16.0;
+  WorldPos = vec3(xz.x, Height, xz.y);
+  TexCoord = uv;
+  gl_Position = viewProjection * vec4(WorldPos, 1.0);
+}
+)";
+
+void CdlodGrid::init()
+{
+    std::vector<unsigned char> vertices;
+    vertices.reserve((CDLOD_GRID + 1) * (CDLOD_GRID + 1) * 2);
+    for (unsigned j = 0; j <= CDLOD_GRID; j++)
+    {
+        for (unsigned i = 0; i <= CDLOD_GRID; i++)
+        {
+            vertices.push_back((unsigned char)i);
+            vertices.push_back((unsigned char)j);
+        }
+    }
+    // the diagonal runs the same way in every cell, so a fully morphed 2x2
+    // block is exactly the parent's cell
+    std::vector<unsigned short> indices;
+    unsigned stride = CDLOD_GRID + 1;
+    for (unsigned j = 0; j < CDLOD_GRID; j++)
+    {
+        for (unsigned i = 0; i < CDLOD_GRID; i++)
+        {
+            unsigned short a = (unsigned short)(j * stride + i), b = (unsigned short)(a + 1);
+            unsigned short c = (unsigned short)(a + stride), d = (unsigned short)(c + 1);
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+    indexCount = (unsigned)indices.size();
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribIPointer(0, 2, GL_UNSIGNED_BYTE, 2, (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // the nodes live in the frame ring; setNodes() points this at them
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(1);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    std::cout << "CDLOD nodes of " << CDLOD_GRID << "x" << CDLOD_GRID << " cells, no tessellation" << std::endl;
+}
+
+void CdlodGrid::setNodes(const std::vector<glm::vec4>& selected, FrameRing& ring)
+{
+    size_t offset;
+    if (!ring.write(selected.data(), selected.size() * sizeof(glm::vec4), offset)) {
+        nodes = 0;
+        return;
+    }
+    glVertexArrayVertexBuffer(vao, 1, ring.buffer(), offset, sizeof(glm::vec4));
+    nodes = (unsigned)selected.size();
+}
+
+void CdlodGrid::draw() const
+{
+    glBindVertexArray(vao);
+    glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, (void*)0, nodes);
+}
+
+void CdlodGrid::destroy()
+{
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ebo);
+    vao = vbo = ebo = 0;
+    nodes = 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class FrameRing;
+
+// Cells per side of the mesh every CDLOD node is drawn with.
+const unsigned CDLOD_GRID = 8;
+// TerrainQuadtree::lodRange for CDLOD: the morph below needs it above 1.5.
+const float CDLOD_LOD_RANGE = 3.0f;
+
+// CDLOD (Strugar, "Continuous Distance-Dependent Level of Detail"): the
+// nodes TerrainQuadtree::selectGround() picks, each drawn as one instance of
+// a fixed CDLOD_GRID x CDLOD_GRID triangle grid, with no tessellation
+// stages at all. Towards the distance where its parent would take over,
+// CDLOD_VS slides a node's odd vertices onto their even neighbours, so at
+// that distance the node is its parent's grid and LOD changes never pop.
+//
+// The ranges make neighbours agree: a node of extent e is only drawn when
+// its ground distance is at least lodRange * e, it morphs from
+// (lodRange + 1.5) * e to 2 * lodRange * e, and its vertices are within
+// e * sqrt(2) of its box. A coarser neighbour's edge is therefore always
+// past the end of the morph, and a finer neighbour's before its start.
+class CdlodGrid {
+public:
+  void init();
+  // Per-node (u0, v0, size) in texture space, as selectGround() emits them;
+  // written to this frame's part of `ring`.
+  void setNodes(const std::vector<glm::vec4>& nodes, FrameRing& ring);
+  void draw() const;
+  void destroy();
+
+  unsigned nodeCount() const { return nodes; }
+
+private:
+  unsigned int vao = 0, vbo = 0, ebo = 0;
+  unsigned indexCount = 0, nodes = 0;
+};
+
+// Vertex shader for CdlodGrid; TERRAIN_HEIGHT_GLSL goes between the
+// #version line and this body. Writes the same WorldPos / TexCoord /
+// Height as the tessellation path, so it pairs with the terrain's fragment
+// shader.
+extern const char* CDLOD_VS;
@@ -0,0 +1,256 @@
+#include "clipmap.hpp"
+
+#include "virtual_heightmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+const char* CLIPMAP_VS = R"(
+#version 450 core
+layout (location = 0) in uvec2 aGrid;
+
+uniform sampler2DArray clipmap; // one toroidal layer per level
+uniform int clipGrid;           // cells per level side
+uniform int clipTexels;         // layer size
+uniform vec2 terrainSize;
+uniform ivec2 clipOrigin;       // lattice coordinate of aGrid (0, 0)
+uniform int clipLevel;
+uniform bool clipBlend;         // a coarser level surrounds this one
+
+out vec3 WorldPos;
+out vec2 TexCoord;
+out float Height;
+
+float clipHeight(int level, ivec2 lattice)
+{
+  ivec2 wrapped = lattice - clipTexels * ivec2(floor(vec2(lattice) / float(clipTexels)));
+  return texelFetch(clipmap, ivec3(wrapped, level), 0).r;
+}
+
+void main(){
+  ivec2 lattice = clipOrigin + ivec2(aGrid);
+  float h = clipHeight(clipLevel, lattice);
+  if (clipBlend) {
+    // the outer tenth morphs into the coarser level: at the edge, vertices
+    // between two coarse ones sit at their average, on the coarse edge
+    ivec2 cell = ivec2(aGrid);
+    int edge = min(min(cell.x, cell.y), min(clipGrid - cell.x, clipGrid - cell.y));
+    float blend = clamp(1.0 - float(edge) / float(max(clipGrid / 10, 1)), 0.0, 1.0);
+    if (blend > 0.0) {
+      ivec2 c = lattice >> 1;
+      ivec2 odd = lattice & 1;
+      float coarse = 0.25 * (clipHeight(clipLevel + 1, c) + clipHeight(clipLevel + 1, c + ivec2(odd.x, 0)) +
+                             clipHeight(clipLevel + 1, c + ivec2(0, odd.y)) + clipHeight(clipLevel + 1, c + odd));
+      h = mix(h, coarse, blend);
+    }
+  }
+
+  // outside the map the grid collapses onto its edge
+  vec2 pos = clamp(vec2(lattice) * float(1 << clipLevel) - terrainSize * 0.5, -terrainSize * 0.5, terrainSize * 0.5);
+  Height = h * 64.0 - 16.0;
+  WorldPos = vec3(pos.x, Height, pos.y);
+  TexCoord = pos / terrainSize + 0.5;
+  gl_Position = viewProjection * vec4(WorldPos, 1.0);
+}
+)";
+
+static int floorMod(int a, int b)
+{
+    int m = a % b;
+    return m < 0 ? m + b : m;
+}
+
+// Two triangles per cell of a grid x grid lattice, skipping the hole cells
+// [hole.x, hole.x + holeSize) x [hole.y, hole.y + holeSize).
+static void buildCells(int grid, glm::ivec2 hole, int holeSize, std::vector<unsigned short>& indices)
+{
+    int stride = grid + 1;
+    for (int j = 0; j < grid; j++)
+    {
+        for (int i = 0; i < grid; i++)
+        {
+            if (i >= hole.x && i < hole.x + holeSize && j >= hole.y && j < hole.y + holeSize)
+                continue;
+            unsigned short a = (unsigned short)(j * stride + i), b = (unsigned short)(a + 1);
+            unsigned short c = (unsigned short)(a + stride), d = (unsigned short)(c + 1);
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+}
+
+bool TerrainClipmap::init(const TerrainImage& heights, const VirtualHeightmap* virtualTiles, int width, int height,
+                          unsigned grid)
+{
+    grid = std::clamp(grid, MIN_CLIPMAP_GRID, MAX_CLIPMAP_GRID) / 4 * 4;
+    gridSize = (int)grid;
+    texels = gridSize + 1;
+    layout = heights.layout;
+    const unsigned short* data = (const unsigned short*)heights.data;
+    mips.assign(data, data + layout.dataSize() / sizeof(unsigned short));
+    tiles = virtualTiles;
+    tileLevels = tiles ? tiles->levels() : 0;
+    mapWidth = width;
+    mapHeight = height;
+
+    // enough levels for the coarsest to cover the map from any corner
+    unsigned count = 1;
+    while (count < tileLevels + layout.levels && (gridSize << (count - 1)) < 2 * std::max(width, height))
+        count++;
+    levels.assign(count, Level());
+
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+    glTextureStorage3D(texture, 1, GL_R16, texels, texels, count);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    std::vector<unsigned short> vertices;
+    vertices.reserve((size_t)texels * texels * 2);
+    for (int j = 0; j <= gridSize; j++)
+    {
+        for (int i = 0; i <= gridSize; i++)
+        {
+            vertices.push_back((unsigned short)i);
+            vertices.push_back((unsigned short)j);
+        }
+    }
+    // the finest level's full grid, then a ring per hole offset: a level
+    // snapped to every other vertex leaves the finer one a hole of half
+    // its size starting grid / 4 cells in, or one more, on each axis
+    std::vector<unsigned short> indices;
+    buildCells(gridSize, glm::ivec2(0), 0, indices);
+    fullCount = (unsigned)indices.size();
+    ringOffset = fullCount;
+    for (int offset = 0; offset < 4; offset++)
+        buildCells(gridSize, glm::ivec2(gridSize / 4 + (offset & 1), gridSize / 4 + (offset >> 1)), gridSize / 2,
+                   indices);
+    ringCount = (unsigned)(indices.size() - fullCount) / 4;
+
+    glCreateVertexArrays(1, &vao);
+    glCreateBuffers(1, &vbo);
+    glCreateBuffers(1, &ebo);
+    glNamedBufferStorage(vbo, vertices.size() * sizeof(unsigned short), vertices.data(), 0);
+    glNamedBufferStorage(ebo, indices.size() * sizeof(unsigned short), indices.data(), 0);
+    glVertexArrayVertexBuffer(vao, 0, vbo, 0, 2 * sizeof(unsigned short));
+    glVertexArrayElementBuffer(vao, ebo);
+    glVertexArrayAttribIFormat(vao, 0, 2, GL_UNSIGNED_SHORT, 0);
+    glVertexArrayAttribBinding(vao, 0, 0);
+    glEnableVertexArrayAttrib(vao, 0);
+
+    std::printf("Clipmap: %u levels of %dx%d cells, %.1f MB of heights\n", count, gridSize, gridSize,
+                (double)texels * texels * count * sizeof(unsigned short) / 1048576.0);
+    return true;
+}
+
+unsigned short TerrainClipmap::texel(unsigned level, int x, int y) const
+{
+    if (level < tileLevels)
+        return tiles->texel(level, x, y);
+    unsigned mip = std::min(level - tileLevels, layout.levels - 1);
+    // levels past the mip chain read its last image
+    int shift = (int)(level - tileLevels - mip);
+    x = std::clamp(x >> shift, 0, layout.levelWidth(mip) - 1);
+    y = std::clamp(y >> shift, 0, layout.levelHeight(mip) - 1);
+    const unsigned short* image = mips.data() + layout.imageOffset(mip, 0) / sizeof(unsigned short);
+    return image[(size_t)y * layout.levelWidth(mip) + x];
+}
+
+unsigned short TerrainClipmap::source(unsigned level, int x, int y) const
+{
+    // vertices sit on texel corners, where heightMap's bilinear filter
+    // averages the four texels around
+    return (unsigned short)((texel(level, x - 1, y - 1) + texel(level, x, y - 1) + texel(level, x - 1, y) +
+                             texel(level, x, y) + 2) / 4);
+}
+
+void TerrainClipmap::upload(unsigned level, int x, int y, int w, int h)
+{
+    if (w <= 0 || h <= 0)
+        return;
+    int tx = floorMod(x, texels), ty = floorMod(y, texels);
+    int w0 = std::min(w, texels - tx), h0 = std::min(h, texels - ty);
+    if (w0 < w || h0 < h) {
+        upload(level, x, y, w0, h0);
+        upload(level, x + w0, y, w - w0, h0);
+        upload(level, x, y + h0, w0, h - h0);
+        upload(level, x + w0, y + h0, w - w0, h - h0);
+        return;
+    }
+    scratch.resize((size_t)w * h);
+    for (int j = 0; j < h; j++)
+        for (int i = 0; i < w; i++)
+            scratch[(size_t)j * w + i] = source(level, x + i, y + j);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTextureSubImage3D(texture, 0, tx, ty, level, w, h, 1, GL_RED, GL_UNSIGNED_SHORT, scratch.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    uploaded += (size_t)w * h;
+}
+
+void TerrainClipmap::update(const glm::vec3& cameraPos)
+{
+    // the camera in level-0 texels from the map's corner
+    float cx = cameraPos.x + mapWidth * 0.5f, cz = cameraPos.z + mapHeight * 0.5f;
+    for (unsigned l = 0; l < levels.size(); l++) {
+        float spacing = (float)(1u << l);
+        glm::ivec2 origin((int)std::floor(cx / (2.0f * spacing)) * 2 - gridSize / 2,
+                          (int)std::floor(cz / (2.0f * spacing)) * 2 - gridSize / 2);
+        Level& level = levels[l];
+        if (level.valid && origin == level.origin)
+            continue;
+
+        glm::ivec2 moved = origin - level.origin;
+        if (!level.valid || std::abs(moved.x) >= texels || std::abs(moved.y) >= texels) {
+            upload(l, origin.x, origin.y, texels, texels);
+        }
+        else {
+            // the columns that came into view over every row, then the rows
+            // that did over the columns left
+            int keptX = moved.x > 0 ? origin.x : level.origin.x;
+            int keptW = texels - std::abs(moved.x);
+            if (moved.x > 0)
+                upload(l, level.origin.x + texels, origin.y, moved.x, texels);
+            else
+                upload(l, origin.x, origin.y, -moved.x, texels);
+            if (moved.y > 0)
+                upload(l, keptX, level.origin.y + texels, keptW, moved.y);
+            else
+                upload(l, keptX, origin.y, keptW, -moved.y);
+        }
+        level.origin = origin;
+        level.valid = true;
+    }
+}
+
+void TerrainClipmap::draw(const ShaderProgram& program) const
+{
+    glUniform1i(program.uniform("clipGrid"), gridSize);
+    glUniform1i(program.uniform("clipTexels"), texels);
+    glBindVertexArray(vao);
+    for (unsigned l = 0; l < levels.size(); l++) {
+        glUniform2i(program.uniform("clipOrigin"), levels[l].origin.x, levels[l].origin.y);
+        glUniform1i(program.uniform("clipLevel"), (int)l);
+        glUniform1i(program.uniform("clipBlend"), l + 1 < levels.size());
+        if (l == 0) {
+            glDrawElements(GL_TRIANGLES, fullCount, GL_UNSIGNED_SHORT, (void*)0);
+            continue;
+        }
+        // where the finer level sits in this one: grid / 4 cells in, or one more
+        int holeX = levels[l - 1].origin.x / 2 - levels[l].origin.x - gridSize / 4;
+        int holeY = levels[l - 1].origin.y / 2 - levels[l].origin.y - gridSize / 4;
+        unsigned offset = (unsigned)(holeX + 2 * holeY);
+        size_t first = ringOffset + (size_t)offset * ringCount;
+        glDrawElements(GL_TRIANGLES, ringCount, GL_UNSIGNED_SHORT, (void*)(first * sizeof(unsigned short)));
+    }
+}
+
+void TerrainClipmap::destroy()
+{
+    glDeleteTextures(1, &texture);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ebo);
+    texture = vao = vbo = ebo = 0;
+    levels.clear();
+    std::vector<unsigned short>().swap(mips);
+}
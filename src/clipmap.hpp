@@ -0,0 +1,79 @@
+#pragma once
+
+#include "shader.hpp"
+#include "terrain_asset.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class VirtualHeightmap;
+
+// Cells per clipmap level side: a multiple of 4 so every level's hole is
+// whole cells, and small enough for 16-bit indices.
+const unsigned MIN_CLIPMAP_GRID = 8;
+const unsigned MAX_CLIPMAP_GRID = 252;
+
+// Geometry clipmap (Losasso & Hoppe): nested square grids of grid x grid
+// cells centred on the camera, level l spaced 2^l level-0 texels apart, so
+// the vertex cost per frame depends on the grid and the level count only,
+// never on the map size. Each level is snapped to every other one of its
+// vertices, which leaves the next finer level a hole of half its size at
+// one of four offsets; one full grid and the four rings around those holes
+// are all the index data there is.
+//
+// A level's heights live in its layer of a GL_R16 array texture, one texel
+// per vertex, addressed toroidally (lattice coordinate mod the layer size).
+// When the camera moves only the rows and columns that came into view are
+// written. Near its outer edge a level blends into the next coarser one so
+// their edges meet without cracks.
+class TerrainClipmap {
+public:
+  // `heights` is the R16 mip chain heightMap is made from, copied so the
+  // images can be released; a virtual heightmap (whose overview `heights`
+  // is) supplies the levels finer than it. `width` x `height` is the map
+  // in world units.
+  bool init(const TerrainImage& heights, const VirtualHeightmap* tiles, int width, int height, unsigned grid);
+  // Recentres every level on the camera and uploads what came into view.
+  void update(const glm::vec3& cameraPos);
+  // Draws every level with `program`, linked from CLIPMAP_VS.
+  void draw(const ShaderProgram& program) const;
+  void destroy();
+
+  unsigned int heightTexture() const { return texture; }
+  unsigned levelCount() const { return (unsigned)levels.size(); }
+  // heights written since init, in texels
+  size_t uploadedTexels() const { return uploaded; }
+
+private:
+  struct Level {
+    glm::ivec2 origin{0}; // lattice coordinate of the grid's corner
+    bool valid = false;
+  };
+
+  unsigned short texel(unsigned level, int x, int y) const;
+  // the height at lattice point (x, y) of a level
+  unsigned short source(unsigned level, int x, int y) const;
+  // Writes the lattice rectangle at (x, y) of a level into its layer,
+  // split where it wraps around.
+  void upload(unsigned level, int x, int y, int w, int h);
+
+  std::vector<unsigned short> mips;
+  TextureLayout layout;
+  const VirtualHeightmap* tiles = nullptr;
+  unsigned tileLevels = 0;
+  int mapWidth = 0, mapHeight = 0;
+  int gridSize = 0, texels = 0;
+
+  std::vector<Level> levels;
+  std::vector<unsigned short> scratch;
+  size_t uploaded = 0;
+
+  unsigned int texture = 0, vao = 0, vbo = 0, ebo = 0;
+  unsigned ringOffset = 0, ringCount = 0, fullCount = 0; // in indices
+};
+
+// Vertex shader for the clipmap: writes the same WorldPos / TexCoord /
+// Height as the tessellation path, so it pairs with the terrain's fragment
+// shader.
+extern const char* CLIPMAP_VS;
@@ -0,0 +1,191 @@
+#include "cubemap_loader.hpp"
+
+#include "texture_cache.hpp"
+#include "texture_codec.hpp"
+
+#include <glad/glad.h>
+
+#include "../dep/stb/stb_image.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+void CubemapLoader::start(const std::vector<std::string>& facePaths, JobSystem& jobPool,
+                          const unsigned char placeholder[3], bool compress)
+{
+    pool = &jobPool;
+    started = std::chrono::steady_clock::now();
+    paths = facePaths;
+
+    glGenTextures(1, &placeholderTexture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, placeholderTexture);
+    for (unsigned i = 0; i < FACES; i++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholder);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // the first face's header sizes the cubemap and the staging buffer
+    int w, h, n;
+    if (paths.size() != FACES || !stbi_info(paths[0].c_str(), &w, &h, &n) || w != h) {
+        std::cout << "Cubemap tex failed to load at path: " << (paths.empty() ? "" : paths[0]) << std::endl;
+        return;
+    }
+    faceSize = w;
+    layout.format = compress ? GL_COMPRESSED_RGBA_BPTC_UNORM : GL_RGB8;
+    layout.width = layout.height = faceSize;
+    layout.faces = FACES;
+    faceBytes = layout.imageSize(0);
+
+    glGenTextures(1, &cubemap);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, layout.format, faceSize, faceSize);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    // coherent, so the jobs' writes need no flush before update() uploads
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &stagingBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, FACES * faceBytes, nullptr, flags);
+    staging = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, FACES * faceBytes, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!compress) {
+        for (unsigned i = 0; i < FACES; i++) {
+            jobs.push_back(pool->submit([this, i]() {
+                int fw, fh, fn;
+                unsigned char* data = stbi_load(paths[i].c_str(), &fw, &fh, &fn, 3);
+                bool ok = data && staging && fw == faceSize && fh == faceSize;
+                if (ok)
+                    std::memcpy(staging + i * faceBytes, data, faceBytes);
+                stbi_image_free(data);
+                faces[i].store(ok ? FACE_DECODED : FACE_FAILED, std::memory_order_release);
+            }, {}, "skybox"));
+        }
+        return;
+    }
+
+    cachePath = textureCachePath("skybox.bc7");
+    cacheKey = textureCacheKey(paths);
+    if (staging && textureCacheValid(cachePath, cacheKey, layout)) {
+        jobs.push_back(pool->submit([this]() {
+            bool ok = readTextureCache(cachePath, cacheKey, layout, staging);
+            for (unsigned i = 0; i < FACES; i++)
+                faces[i].store(ok ? FACE_DECODED : FACE_FAILED, std::memory_order_release);
+        }, {}, "skybox"));
+        return;
+    }
+
+    encoded.resize(FACES * faceBytes);
+    int blockRows = (faceSize + BC_BLOCK - 1) / BC_BLOCK;
+    int grain = std::max(1, (1 << 16) / (faceSize * BC_BLOCK));
+    for (unsigned i = 0; i < FACES; i++) {
+        JobHandle decode = pool->submit([this, i]() {
+            int fw, fh, fn;
+            pixels[i] = stbi_load(paths[i].c_str(), &fw, &fh, &fn, 3);
+            if (pixels[i] && (fw != faceSize || fh != faceSize)) {
+                stbi_image_free(pixels[i]);
+                pixels[i] = nullptr;
+            }
+        }, {}, "skybox");
+        std::vector<JobHandle> blocks = pool->parallelFor(0, blockRows, grain, [this, i](int by0, int by1) {
+            if (pixels[i])
+                compressBC7Rows(pixels[i], faceSize, faceSize, 3, by0, by1, encoded.data() + i * faceBytes);
+        }, { decode }, "skybox bc7");
+        jobs.push_back(pool->submit([this, i]() {
+            bool ok = pixels[i] && staging;
+            if (ok)
+                std::memcpy(staging + i * faceBytes, encoded.data() + i * faceBytes, faceBytes);
+            stbi_image_free(pixels[i]);
+            pixels[i] = nullptr;
+            encodedOk[i] = ok;
+            faces[i].store(ok ? FACE_DECODED : FACE_FAILED, std::memory_order_release);
+        }, blocks));
+    }
+    // not in `jobs`: it may still be writing once every face is uploaded
+    cacheWriter = pool->submit([this]() {
+        bool complete = true;
+        for (unsigned i = 0; i < FACES; i++)
+            complete = complete && encodedOk[i];
+        if (complete)
+            writeTextureCache(cachePath, cacheKey, layout, encoded.data());
+        std::vector<unsigned char>().swap(encoded);
+    }, jobs);
+}
+
+void CubemapLoader::load(const TerrainImage& image)
+{
+    layout = image.layout;
+    faceSize = layout.width;
+    cubemap = uploadTexture(layout, image.data);
+    uploaded = FACES;
+}
+
+void CubemapLoader::update()
+{
+    if (!cubemap || uploaded == FACES)
+        return;
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+    for (unsigned i = 0; i < FACES; i++) {
+        int state = faces[i].load(std::memory_order_acquire);
+        if (state == FACE_DECODED && layout.format == GL_RGB8) {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, faceSize, faceSize,
+                            GL_RGB, GL_UNSIGNED_BYTE, (const void*)(i * faceBytes));
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+        else if (state == FACE_DECODED) {
+            glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, faceSize, faceSize,
+                                      layout.format, (GLsizei)faceBytes, (const void*)(i * faceBytes));
+        }
+        else if (state == FACE_FAILED) {
+            std::cout << "Cubemap tex failed to load at path: " << paths[i] << std::endl;
+        }
+        else {
+            continue;
+        }
+        faces[i].store(FACE_UPLOADED, std::memory_order_relaxed);
+        uploaded++;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (uploaded == FACES) {
+        // GL keeps the storage alive until the uploads above have read it
+        glDeleteBuffers(1, &stagingBuffer);
+        stagingBuffer = 0;
+        staging = nullptr;
+        glDeleteTextures(1, &placeholderTexture);
+        placeholderTexture = 0;
+        jobs.clear();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        std::cout << "Skybox ready after " << ms << " ms" << std::endl;
+    }
+}
+
+void CubemapLoader::finish()
+{
+    if (pool)
+        pool->wait(pool->after(jobs));
+    update();
+}
+
+void CubemapLoader::destroy()
+{
+    if (pool) {
+        pool->wait(pool->after(jobs));
+        pool->wait(cacheWriter);
+    }
+    jobs.clear();
+    cacheWriter = nullptr;
+    glDeleteTextures(1, &placeholderTexture);
+    glDeleteTextures(1, &cubemap);
+    glDeleteBuffers(1, &stagingBuffer);
+    placeholderTexture = cubemap = stagingBuffer = 0;
+    staging = nullptr;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "job_system.hpp"
+#include "terrain_asset.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Loads a six-face cubemap in the background, as BC7 or plain RGB8. start()
+// hands out a 1x1 placeholder right away; each face is then decoded as its
+// own job (and for BC7 compressed in block-row jobs), or a BC7 cubemap is
+// read back whole from the texture cache when its faces have not changed. Finished faces are copied
+// into a persistently mapped pixel unpack buffer, and update() - once per
+// frame on the GL thread - uploads whatever faces are ready from there.
+// When the last face is in, texture() switches to the real cubemap and the
+// placeholder and staging buffer are freed.
+//
+// Faces must all have the size of the first one.
+class CubemapLoader {
+public:
+  // `placeholder` is the placeholder's colour, 8-bit RGB.
+  void start(const std::vector<std::string>& facePaths, JobSystem& pool,
+             const unsigned char placeholder[3], bool compress);
+  // A cubemap that is already packed, e.g. a terrain asset's skybox
+  // section: uploaded right away, no placeholder.
+  void load(const TerrainImage& image);
+  void update();
+  // Blocks until every face is decoded and uploaded (benchmarks want the
+  // real sky from frame 0).
+  void finish();
+  // Waits for decodes still running, since they write to the staging buffer,
+  // and for the texture cache write.
+  void destroy();
+
+  bool ready() const { return cubemap != 0 && uploaded == FACES; }
+  unsigned int texture() const { return ready() ? cubemap : placeholderTexture; }
+
+private:
+  static const unsigned FACES = 6;
+
+  JobSystem* pool = nullptr;
+  std::vector<std::string> paths;
+  std::vector<JobHandle> jobs;
+  JobHandle cacheWriter; // cache miss only; outlives the face jobs
+  enum FaceState { FACE_PENDING, FACE_DECODED, FACE_FAILED, FACE_UPLOADED };
+  std::atomic<int> faces[FACES] = {}; // FaceState, written by the decode jobs
+  unsigned uploaded = 0;              // faces done, failed ones included
+
+  // cache miss only: decoded faces until compressed, and the compressed
+  // cubemap until written to the cache
+  unsigned char* pixels[FACES] = {};
+  bool encodedOk[FACES] = {};
+  std::vector<unsigned char> encoded;
+  TextureLayout layout; // the cubemap's format and size in either case
+  std::string cachePath, cacheKey;
+
+  unsigned int placeholderTexture = 0, cubemap = 0;
+  unsigned int stagingBuffer = 0;
+  unsigned char* staging = nullptr; // persistently mapped, FACES * faceBytes
+  int faceSize = 0;
+  size_t faceBytes = 0;
+  std::chrono::steady_clock::time_point started;
+};
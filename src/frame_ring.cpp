@@ -0,0 +1,111 @@
+#include "frame_ring.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static size_t alignUp(size_t bytes, size_t alignment)
+{
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+bool FrameRing::init(size_t bytesPerFrame)
+{
+    int uniformAlignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    // vec4 instance attributes want 16 bytes whatever the UBO rule is
+    alignment = std::max<size_t>(uniformAlignment, 16);
+    allocate(bytesPerFrame);
+    if (!mapped) {
+        std::cout << "Failed to map the frame ring" << std::endl;
+        return false;
+    }
+    std::cout << "Frame ring: " << RING_FRAMES << " x " << sectionSize / 1024 << " KB, persistently mapped"
+              << std::endl;
+    return true;
+}
+
+void FrameRing::allocate(size_t bytesPerFrame)
+{
+    sectionSize = alignUp(bytesPerFrame, alignment);
+    // coherent, so writes reach the GPU without a flush before the draw
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &id);
+    glNamedBufferStorage(id, RING_FRAMES * sectionSize, nullptr, flags);
+    mapped = (unsigned char*)glMapNamedBufferRange(id, 0, RING_FRAMES * sectionSize, flags);
+}
+
+void FrameRing::beginFrame()
+{
+    section = (section + 1) % RING_FRAMES;
+    head = 0;
+    if (fences[section]) {
+        GLenum result;
+        do
+            result = glClientWaitSync(fences[section], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        while (result == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(fences[section]);
+        fences[section] = 0;
+    }
+    // last frame's draws are queued, and GL keeps a deleted buffer alive
+    // until they are done with it
+    if (!retired.empty()) {
+        glDeleteBuffers((GLsizei)retired.size(), retired.data());
+        retired.clear();
+    }
+}
+
+bool FrameRing::write(const void* data, size_t bytes, size_t& offset)
+{
+    offset = alignUp(head, alignment);
+    if (offset + bytes > sectionSize) {
+        unsigned int old = id;
+        unsigned char* oldMapped = mapped;
+        size_t oldSize = sectionSize;
+        allocate(std::max(sectionSize * 2, bytes));
+        if (!mapped) {
+            // keep writing into the old buffer; this allocation just fails
+            std::cout << "Failed to map a " << RING_FRAMES << " x " << sectionSize / 1024 << " KB frame ring"
+                      << std::endl;
+            glDeleteBuffers(1, &id);
+            id = old;
+            mapped = oldMapped;
+            sectionSize = oldSize;
+            return false;
+        }
+        // nothing is queued against the new buffer yet, so no fence guards it
+        retired.push_back(old);
+        for (GLsync& fence : fences) {
+            if (fence)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+        std::cout << "Frame ring grown to " << RING_FRAMES << " x " << sectionSize / 1024 << " KB" << std::endl;
+        offset = 0;
+    }
+    head = offset + bytes;
+    offset += section * sectionSize;
+    if (bytes)
+        std::memcpy(mapped + offset, data, bytes);
+    return true;
+}
+
+void FrameRing::endFrame()
+{
+    fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void FrameRing::destroy()
+{
+    for (GLsync& fence : fences) {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+    retired.push_back(id);
+    glDeleteBuffers((GLsizei)retired.size(), retired.data());
+    retired.clear();
+    id = 0;
+    mapped = nullptr;
+    sectionSize = head = 0;
+}
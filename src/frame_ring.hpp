@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+// Frames the ring holds: the one being written while the GPU may still be
+// reading the two before it.
+const unsigned RING_FRAMES = 3;
+
+// Per-frame CPU-to-GPU data (the Frame UBO, the quadtree's and CDLOD's node
+// lists) written straight into one persistently mapped, coherent buffer
+// split into RING_FRAMES sections. A frame appends to its own section, a
+// fence after its last draw marks when the GPU is done with it, and the
+// section is only reused once that fence has passed, so uploads never wait
+// on the driver to orphan or copy anything.
+//
+// A frame that outgrows its section moves the ring to a buffer twice the
+// size; what it already wrote stays in the old one, which is deleted when
+// the next frame begins.
+class FrameRing {
+public:
+  bool init(size_t bytesPerFrame);
+  // Moves to the next section, waiting for the GPU if it still reads it.
+  void beginFrame();
+  // Copies `bytes` into this frame's section and sets `offset` to where
+  // they are in buffer(), aligned for glBindBufferRange on uniform buffers.
+  // Bind right after writing: buffer() changes when the ring grows. False
+  // if they did not fit and the ring could not grow.
+  bool write(const void* data, size_t bytes, size_t& offset);
+  // Fences everything submitted so far against this frame's section.
+  void endFrame();
+  void destroy();
+
+  unsigned int buffer() const { return id; }
+
+private:
+  void allocate(size_t bytesPerFrame);
+
+  unsigned int id = 0;
+  unsigned char* mapped = nullptr;
+  size_t sectionSize = 0, alignment = 0, head = 0;
+  unsigned section = 0;
+  GLsync fences[RING_FRAMES] = {};
+  std::vector<unsigned int> retired;
+};
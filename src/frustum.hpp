@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// View frustum as six inward-facing planes (xyz = normal, w = distance),
+// extracted from a view-projection matrix (Gribb/Hartmann).
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+inline Frustum extractFrustum(const glm::mat4& m)
+{
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++)
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+    Frustum f;
+    f.planes[0] = row[3] + row[0]; // left
+    f.planes[1] = row[3] - row[0]; // right
+    f.planes[2] = row[3] + row[1]; // bottom
+    f.planes[3] = row[3] - row[1]; // top
+    f.planes[4] = row[3] + row[2]; // near
+    f.planes[5] = row[3] - row[2]; // far
+    for (glm::vec4& p : f.planes)
+        p /= glm::length(glm::vec3(p));
+    return f;
+}
+
+// False only if the box is completely outside one plane.
+inline bool boxInFrustum(const Frustum& f, const glm::vec3& lo, const glm::vec3& hi)
+{
+    for (const glm::vec4& p : f.planes)
+    {
+        // the box corner furthest along the plane normal
+        glm::vec3 v(p.x > 0.0f ? hi.x : lo.x,
+                    p.y > 0.0f ? hi.y : lo.y,
+                    p.z > 0.0f ? hi.z : lo.z);
+        if (p.x * v.x + p.y * v.y + p.z * v.z + p.w < 0.0f)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,134 @@
+#include "gpu_cull.hpp"
+
+#include "height_pyramid.hpp"
+#include "hiz.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <iostream>
+#include <string>
+
+// HEIGHT_PYRAMID_GLSL goes between the #version line and this body
+const char* CS_PATCH_BOUNDS = R"(
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (std430, binding = 0) writeonly buffer Bounds { vec2 bounds[]; };
+
+uniform uint gridRez;
+
+void main(){
+  uvec2 cell = gl_GlobalInvocationID.xy;
+  if (cell.x >= gridRez || cell.y >= gridRez)
+    return;
+
+  bounds[cell.y * gridRez + cell.x] = heightBounds(vec2(cell) / float(gridRez),
+                                                   vec2(cell + 1u) / float(gridRez));
+}
+)";
+
+// HIZ_GLSL goes between the #version line and this body
+const char* CS_PATCH_CULL = R"(
+layout (local_size_x = 64) in;
+
+layout (std430, binding = 0) readonly buffer Bounds { vec2 bounds[]; };
+layout (std430, binding = 1) writeonly buffer Visible { vec4 visible[]; };
+layout (std430, binding = 2) buffer Command {
+  uint count;
+  uint instanceCount;
+  uint first;
+  uint baseInstance;
+};
+
+uniform uint gridRez;
+uniform vec2 terrainSize;
+uniform bool occlusion;
+
+bool boxInFrustum(vec3 lo, vec3 hi)
+{
+  mat4 m = transpose(viewProjection);
+  vec4 planes[6] = vec4[](m[3] + m[0], m[3] - m[0], m[3] + m[1],
+                          m[3] - m[1], m[3] + m[2], m[3] - m[2]);
+  for (int i = 0; i < 6; i++) {
+    vec3 v = mix(lo, hi, greaterThan(planes[i].xyz, vec3(0.0)));
+    if (dot(planes[i].xyz, v) + planes[i].w < 0.0)
+      return false;
+  }
+  return true;
+}
+
+void main(){
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= gridRez * gridRez)
+    return;
+
+  float du = 1.0 / float(gridRez);
+  vec2 uv0 = vec2(id % gridRez, id / gridRez) * du;
+  vec3 lo = vec3(terrainSize.x * (uv0.x - 0.5), bounds[id].x, terrainSize.y * (uv0.y - 0.5));
+  vec3 hi = vec3(lo.x + terrainSize.x * du, bounds[id].y, lo.z + terrainSize.y * du);
+  if (!boxInFrustum(lo, hi) || (occlusion && boxOccluded(lo, hi)))
+    return;
+
+  visible[atomicAdd(instanceCount, 1u)] = vec4(uv0, du, du);
+}
+)";
+
+bool GpuPatchCuller::init(unsigned int heightPyramid, const PatchGrid& grid, int width, int height)
+{
+    std::string boundsSource = std::string("#version 450 core\n") + HEIGHT_PYRAMID_GLSL + CS_PATCH_BOUNDS;
+    std::string cullSource = std::string("#version 450 core\n") + HIZ_GLSL + CS_PATCH_CULL;
+    if (!boundsProgram.link({{GL_COMPUTE_SHADER, boundsSource.c_str()}}) ||
+        !cullProgram.link({{GL_COMPUTE_SHADER, cullSource.c_str()}}))
+        return false;
+
+    patchCount = grid.rez * grid.rez;
+    glGenBuffers(1, &boundsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, patchCount * 2 * sizeof(float), NULL, GL_STATIC_DRAW);
+
+    boundsProgram.use();
+    glUniform1i(boundsProgram.uniform("heightPyramid"), 2);
+    glUniform1ui(boundsProgram.uniform("gridRez"), grid.rez);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, heightPyramid);
+    glActiveTexture(GL_TEXTURE0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, boundsBuffer);
+    glDispatchCompute((grid.rez + 7) / 8, (grid.rez + 7) / 8, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    cullProgram.use();
+    glUniform1ui(cullProgram.uniform("gridRez"), grid.rez);
+    glUniform2f(cullProgram.uniform("terrainSize"), (float)width, (float)height);
+    glUniform1i(cullProgram.uniform("hiZ"), HIZ_TEXTURE_UNIT);
+
+    std::cout << "GPU culling " << patchCount << " patches" << std::endl;
+    return true;
+}
+
+void GpuPatchCuller::cull(const PatchGrid& grid, const HiZBuffer* hiz, const glm::mat4& hizViewProjection)
+{
+    // instanceCount back to zero; the dispatch atomically counts survivors
+    const unsigned int command[4] = { 4, 0, 0, 0 };
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, grid.indirect);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), command);
+
+    cullProgram.use();
+    bool occlusion = hiz && hiz->valid();
+    glUniform1i(cullProgram.uniform("occlusion"), occlusion);
+    if (occlusion) {
+        glUniformMatrix4fv(cullProgram.uniform("hiZViewProjection"), 1, GL_FALSE, glm::value_ptr(hizViewProjection));
+        glUniform2i(cullProgram.uniform("hiZPixels"), hiz->pixels().x, hiz->pixels().y);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, boundsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, grid.vbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, grid.indirect);
+    glDispatchCompute((patchCount + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GpuPatchCuller::destroy()
+{
+    boundsProgram.destroy();
+    cullProgram.destroy();
+    glDeleteBuffers(1, &boundsBuffer);
+    boundsBuffer = 0;
+}
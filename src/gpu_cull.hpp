@@ -0,0 +1,27 @@
+#pragma once
+
+#include "shader.hpp"
+#include "terrain.hpp"
+
+class HiZBuffer;
+
+// GPU-driven culling for a GRID_GPU PatchGrid. init() looks up per-patch
+// min/max heights in the HeightPyramid texture once; cull() tests every patch's
+// bounding box against the frustum of the current Frame UBO and compacts
+// the survivors into the grid's instance buffer, bumping the instance count
+// of its indirect draw command. The CPU cost per frame is constant.
+//
+// Given a built HiZBuffer, cull() also drops patches that were hidden
+// behind the depth it holds, seen through `hizViewProjection`, the camera
+// of the frame it was built from.
+class GpuPatchCuller {
+public:
+  bool init(unsigned int heightPyramid, const PatchGrid& grid, int width, int height);
+  void cull(const PatchGrid& grid, const HiZBuffer* hiz, const glm::mat4& hizViewProjection);
+  void destroy();
+
+private:
+  ShaderProgram boundsProgram, cullProgram;
+  unsigned int boundsBuffer = 0;
+  unsigned patchCount = 0;
+};
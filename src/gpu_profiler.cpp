@@ -0,0 +1,212 @@
+#include "gpu_profiler.hpp"
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+void parseProfilerArgs(int argc, char** argv, ProfilerOptions& opts)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--profile") == 0)
+            opts.enabled = true;
+        else if (std::strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc)
+        {
+            opts.enabled = true;
+            opts.outPath = argv[++i];
+        }
+    }
+}
+
+void GpuProfiler::init(bool history, unsigned warmupFrames)
+{
+    keepHistory = history;
+    warmup = warmupFrames;
+}
+
+void GpuProfiler::destroy()
+{
+    for (const PendingFrame& f : pending)
+        for (const PassQuery& q : f.queries) {
+            freeTimeQueries.push_back(q.time);
+            freePrimQueries.push_back(q.prims);
+        }
+    pending.clear();
+    if (!freeTimeQueries.empty())
+        glDeleteQueries((GLsizei)freeTimeQueries.size(), freeTimeQueries.data());
+    if (!freePrimQueries.empty())
+        glDeleteQueries((GLsizei)freePrimQueries.size(), freePrimQueries.data());
+    freeTimeQueries.clear();
+    freePrimQueries.clear();
+}
+
+unsigned GpuProfiler::passIndex(const char* name)
+{
+    for (unsigned i = 0; i < names.size(); i++)
+        if (names[i] == name)
+            return i;
+    names.push_back(name);
+    return (unsigned)names.size() - 1;
+}
+
+unsigned int GpuProfiler::acquireQuery(std::vector<unsigned int>& pool)
+{
+    if (pool.empty()) {
+        unsigned int q;
+        glGenQueries(1, &q);
+        return q;
+    }
+    unsigned int q = pool.back();
+    pool.pop_back();
+    return q;
+}
+
+void GpuProfiler::beginFrame(unsigned frame)
+{
+    current.frame = frame;
+    current.queries.clear();
+}
+
+void GpuProfiler::beginPass(const char* name)
+{
+    PassQuery q;
+    q.pass = passIndex(name);
+    q.time = acquireQuery(freeTimeQueries);
+    q.prims = acquireQuery(freePrimQueries);
+    glBeginQuery(GL_TIME_ELAPSED, q.time);
+    glBeginQuery(GL_PRIMITIVES_GENERATED, q.prims);
+    current.queries.push_back(q);
+    inPass = true;
+}
+
+void GpuProfiler::endPass()
+{
+    if (!inPass)
+        return;
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+    glEndQuery(GL_TIME_ELAPSED);
+    inPass = false;
+}
+
+bool GpuProfiler::ready(const PendingFrame& f) const
+{
+    // queries of one frame complete in submission order
+    if (f.queries.empty())
+        return true;
+    const PassQuery& last = f.queries.back();
+    GLuint timeReady = 0, primsReady = 0;
+    glGetQueryObjectuiv(last.time, GL_QUERY_RESULT_AVAILABLE, &timeReady);
+    glGetQueryObjectuiv(last.prims, GL_QUERY_RESULT_AVAILABLE, &primsReady);
+    return timeReady && primsReady;
+}
+
+void GpuProfiler::resolve(const PendingFrame& f)
+{
+    if (resolved++ < warmup) {
+        for (const PassQuery& q : f.queries) {
+            freeTimeQueries.push_back(q.time);
+            freePrimQueries.push_back(q.prims);
+        }
+        return;
+    }
+
+    GpuFrameSample s;
+    s.frame = f.frame;
+    s.passes.assign(names.size(), GpuPassSample{0.0, 0});
+    for (const PassQuery& q : f.queries) {
+        GLuint64 elapsed = 0, prims = 0;
+        glGetQueryObjectui64v(q.time, GL_QUERY_RESULT, &elapsed);
+        glGetQueryObjectui64v(q.prims, GL_QUERY_RESULT, &prims);
+        s.passes[q.pass].ms += elapsed / 1.0e6;
+        s.passes[q.pass].primitives += prims;
+        freeTimeQueries.push_back(q.time);
+        freePrimQueries.push_back(q.prims);
+    }
+
+    recent.push_back(s);
+    if (recent.size() > WINDOW)
+        recent.pop_front();
+    if (keepHistory)
+        frames.push_back(s);
+}
+
+void GpuProfiler::endFrame()
+{
+    endPass();
+    pending.push_back(current);
+    while (!pending.empty() && ready(pending.front())) {
+        resolve(pending.front());
+        pending.pop_front();
+    }
+}
+
+void GpuProfiler::flush()
+{
+    while (!pending.empty()) {
+        resolve(pending.front());
+        pending.pop_front();
+    }
+}
+
+std::string GpuProfiler::summary() const
+{
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    double total = 0.0;
+    for (unsigned p = 0; p < names.size(); p++) {
+        double ms = 0.0, prims = 0.0;
+        unsigned n = 0;
+        for (const GpuFrameSample& s : recent)
+            if (p < s.passes.size()) {
+                ms += s.passes[p].ms;
+                prims += s.passes[p].primitives;
+                n++;
+            }
+        if (n) {
+            ms /= n;
+            prims /= n;
+        }
+        total += ms;
+        out << names[p] << " " << ms << " ms " << (unsigned long long)prims << " prims | ";
+    }
+    out << "gpu " << total << " ms";
+    return out.str();
+}
+
+bool GpuProfiler::dump(const std::string& path) const
+{
+    std::ofstream out(path);
+    if (!out) {
+        std::cout << "Failed to open profiler output: " << path << std::endl;
+        return false;
+    }
+
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (json) {
+        out << "{\n  \"passes\": [";
+        for (unsigned p = 0; p < names.size(); p++)
+            out << (p ? ", " : "") << "\"" << names[p] << "\"";
+        out << "],\n  \"frames\": [\n";
+        for (size_t i = 0; i < frames.size(); i++) {
+            const GpuFrameSample& s = frames[i];
+            out << "    {\"frame\": " << s.frame;
+            for (unsigned p = 0; p < s.passes.size(); p++)
+                out << ", \"" << names[p] << "\": {\"gpu_ms\": " << s.passes[p].ms
+                    << ", \"primitives\": " << s.passes[p].primitives << "}";
+            out << "}" << (i + 1 < frames.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+    }
+    else {
+        out << "frame,pass,gpu_ms,primitives\n";
+        for (const GpuFrameSample& s : frames)
+            for (unsigned p = 0; p < s.passes.size(); p++)
+                out << s.frame << "," << names[p] << "," << s.passes[p].ms << "," << s.passes[p].primitives << "\n";
+    }
+    std::cout << "GPU profile: " << frames.size() << " frames -> " << path << std::endl;
+    return true;
+}
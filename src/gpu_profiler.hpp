@@ -0,0 +1,84 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+
+struct GpuPassSample {
+  double ms;
+  unsigned long long primitives;
+};
+
+struct GpuFrameSample {
+  unsigned frame;
+  std::vector<GpuPassSample> passes; // indexed like GpuProfiler::passNames()
+};
+
+struct ProfilerOptions {
+  bool enabled = false;
+  std::string outPath;
+};
+
+// Recognises --profile and --profile-out <file.csv|file.json>.
+void parseProfilerArgs(int argc, char** argv, ProfilerOptions& opts);
+
+// Per-pass GPU time and primitive counts from GL_TIME_ELAPSED /
+// GL_PRIMITIVES_GENERATED queries. Frames stay in flight until the driver
+// reports their results available, so collecting never blocks the render
+// loop; query objects are recycled through a free list, which in practice
+// settles at two or three frames' worth.
+//
+// Passes can not nest (GL_TIME_ELAPSED queries can not be active twice).
+class GpuProfiler {
+public:
+  // The first `warmupFrames` frames are dropped: they include driver warm-up,
+  // and llvmpipe reports garbage for the first timer query of a context.
+  void init(bool keepHistory, unsigned warmupFrames = 1);
+  void destroy();
+
+  void beginFrame(unsigned frame);
+  void beginPass(const char* name);
+  void endPass();
+  void endFrame();
+
+  // Waits for every frame still in flight. Only for shutdown/benchmarks.
+  void flush();
+
+  const std::vector<std::string>& passNames() const { return names; }
+  const std::vector<GpuFrameSample>& history() const { return frames; }
+
+  // Averages over the last WINDOW resolved frames, one line.
+  std::string summary() const;
+  bool dump(const std::string& path) const;
+
+private:
+  static const unsigned WINDOW = 120;
+
+  struct PassQuery {
+    unsigned pass;
+    unsigned int time, prims;
+  };
+  struct PendingFrame {
+    unsigned frame;
+    std::vector<PassQuery> queries;
+  };
+
+  unsigned passIndex(const char* name);
+  unsigned int acquireQuery(std::vector<unsigned int>& pool);
+  bool ready(const PendingFrame& f) const;
+  void resolve(const PendingFrame& f);
+
+  std::vector<std::string> names;
+  // a query object is bound to the target of its first glBeginQuery, so
+  // timer and primitive queries are recycled separately
+  std::vector<unsigned int> freeTimeQueries, freePrimQueries;
+  std::deque<PendingFrame> pending;
+  PendingFrame current;
+  bool inPass = false;
+
+  std::deque<GpuFrameSample> recent;
+  std::vector<GpuFrameSample> frames;
+  bool keepHistory = false;
+  unsigned warmup = 0;
+  unsigned resolved = 0;
+};
@@ -0,0 +1,489 @@
+#include "height_kernels.hpp"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HEIGHT_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+// Scalar versions double as the tails of the SIMD ones, so every variant
+// performs the same float operations in the same order.
+
+static void extractHeights16Scalar(const unsigned char* src, int channels, int channel,
+                                   size_t count, unsigned short* dst)
+{
+    for (size_t i = 0; i < count; i++)
+        dst[i] = (unsigned short)(src[i * channels + channel] * 257);
+}
+
+static void convertHeightsFloatScalar(const unsigned short* src, size_t count, float scale,
+                                      float bias, float* dst)
+{
+    for (size_t i = 0; i < count; i++)
+        dst[i] = (float)src[i] * scale + bias;
+}
+
+static void sobelNormalScalar(const float* a, const float* r, const float* b, int x,
+                              signed char* dst)
+{
+    float dx = ((a[x + 1] + 2.0f * r[x + 1]) + b[x + 1]) - ((a[x - 1] + 2.0f * r[x - 1]) + b[x - 1]);
+    float dz = ((b[x - 1] + 2.0f * b[x]) + b[x + 1]) - ((a[x - 1] + 2.0f * a[x]) + a[x + 1]);
+    // the taps sum to 8 * the per-texel slope
+    dx *= 0.125f;
+    dz *= 0.125f;
+    float inv = 1.0f / std::sqrt((dx * dx + 1.0f) + dz * dz);
+    dst[2 * x - 2] = (signed char)std::lrint(-dx * inv * 127.0f);
+    dst[2 * x - 1] = (signed char)std::lrint(-dz * inv * 127.0f);
+}
+
+static void sobelNormalRowScalar(const float* above, const float* row, const float* below,
+                                 int width, signed char* dst)
+{
+    for (int x = 1; x <= width; x++)
+        sobelNormalScalar(above, row, below, x, dst);
+}
+
+static void reduceMin2x2Scalar(const unsigned short* src0, const unsigned short* src1,
+                               size_t count, unsigned short* dst)
+{
+    for (size_t i = 0; i < count; i++) {
+        unsigned short a = src0[2 * i] < src0[2 * i + 1] ? src0[2 * i] : src0[2 * i + 1];
+        unsigned short b = src1[2 * i] < src1[2 * i + 1] ? src1[2 * i] : src1[2 * i + 1];
+        dst[i] = a < b ? a : b;
+    }
+}
+
+static void reduceMax2x2Scalar(const unsigned short* src0, const unsigned short* src1,
+                               size_t count, unsigned short* dst)
+{
+    for (size_t i = 0; i < count; i++) {
+        unsigned short a = src0[2 * i] > src0[2 * i + 1] ? src0[2 * i] : src0[2 * i + 1];
+        unsigned short b = src1[2 * i] > src1[2 * i + 1] ? src1[2 * i] : src1[2 * i + 1];
+        dst[i] = a > b ? a : b;
+    }
+}
+
+static void boxFilter2x2Scalar(const unsigned short* src0, const unsigned short* src1,
+                               size_t count, unsigned short* dst)
+{
+    for (size_t i = 0; i < count; i++)
+        dst[i] = (unsigned short)((src0[2 * i] + src0[2 * i + 1] + src1[2 * i] + src1[2 * i + 1] + 2) / 4);
+}
+
+static void boxFilterPairs2x2Scalar(const signed char* src0, const signed char* src1,
+                                    size_t count, signed char* dst)
+{
+    for (size_t i = 0; i < 2 * count; i++) {
+        size_t j = i + (i & ~(size_t)1);
+        int sum = src0[j] + src0[j + 2] + src1[j] + src1[j + 2];
+        dst[i] = (signed char)(sum < 0 ? -((2 - sum) / 4) : (sum + 2) / 4);
+    }
+}
+
+#ifdef HEIGHT_KERNELS_X86
+
+// pshufb mask picking channel `channel` of 4 texels, each byte widened to
+// (v << 8 | v)
+static __m128i channelMask(int channels, int channel)
+{
+    alignas(16) signed char mask[16];
+    for (int i = 0; i < 16; i++) {
+        int texel = i / 2;
+        mask[i] = texel < 4 ? (signed char)(texel * channels + channel) : (signed char)0x80;
+    }
+    return _mm_load_si128((const __m128i*)mask);
+}
+
+// --- SSE4.1 ---
+
+__attribute__((target("sse4.1")))
+static void extractHeights16Sse41(const unsigned char* src, int channels, int channel,
+                                  size_t count, unsigned short* dst)
+{
+    // 4 texels per 16-byte load, which may read past the last texel it
+    // uses, so stop while the last load still fits
+    __m128i mask = channelMask(channels, channel);
+    size_t bytes = count * channels, i = 0;
+    for (; channels <= 4 && (i + 4) * channels + 16 <= bytes; i += 8) {
+        __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * channels)), mask);
+        __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + (i + 4) * channels)), mask);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi64(lo, hi));
+    }
+    extractHeights16Scalar(src + i * channels, channels, channel, count - i, dst + i);
+}
+
+__attribute__((target("sse4.1")))
+static void convertHeightsFloatSse41(const unsigned short* src, size_t count, float scale,
+                                     float bias, float* dst)
+{
+    __m128 s = _mm_set1_ps(scale), b = _mm_set1_ps(bias);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_cvtepu16_epi32(v);
+        __m128i hi = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), s), b));
+        _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), s), b));
+    }
+    convertHeightsFloatScalar(src + i, count - i, scale, bias, dst + i);
+}
+
+__attribute__((target("sse4.1")))
+static void sobelNormalRowSse41(const float* above, const float* row, const float* below,
+                                int width, signed char* dst)
+{
+    const __m128 two = _mm_set1_ps(2.0f), eighth = _mm_set1_ps(0.125f);
+    const __m128 one = _mm_set1_ps(1.0f), snorm = _mm_set1_ps(127.0f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    int x = 1;
+    for (; x + 3 <= width; x += 4) {
+        __m128 a0 = _mm_loadu_ps(above + x - 1), a1 = _mm_loadu_ps(above + x), a2 = _mm_loadu_ps(above + x + 1);
+        __m128 r0 = _mm_loadu_ps(row + x - 1), r2 = _mm_loadu_ps(row + x + 1);
+        __m128 b0 = _mm_loadu_ps(below + x - 1), b1 = _mm_loadu_ps(below + x), b2 = _mm_loadu_ps(below + x + 1);
+
+        __m128 dx = _mm_sub_ps(_mm_add_ps(_mm_add_ps(a2, _mm_mul_ps(two, r2)), b2),
+                               _mm_add_ps(_mm_add_ps(a0, _mm_mul_ps(two, r0)), b0));
+        __m128 dz = _mm_sub_ps(_mm_add_ps(_mm_add_ps(b0, _mm_mul_ps(two, b1)), b2),
+                               _mm_add_ps(_mm_add_ps(a0, _mm_mul_ps(two, a1)), a2));
+        dx = _mm_mul_ps(dx, eighth);
+        dz = _mm_mul_ps(dz, eighth);
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), one), _mm_mul_ps(dz, dz)));
+        __m128 inv = _mm_div_ps(one, len);
+        __m128i nx = _mm_cvtps_epi32(_mm_mul_ps(_mm_mul_ps(_mm_xor_ps(dx, sign), inv), snorm));
+        __m128i nz = _mm_cvtps_epi32(_mm_mul_ps(_mm_mul_ps(_mm_xor_ps(dz, sign), inv), snorm));
+
+        // (x, z) pairs: 8 x i32 -> 8 x i16 -> 8 x i8
+        __m128i pairs = _mm_packs_epi32(_mm_unpacklo_epi32(nx, nz), _mm_unpackhi_epi32(nx, nz));
+        _mm_storel_epi64((__m128i*)(dst + 2 * x - 2), _mm_packs_epi16(pairs, pairs));
+    }
+    for (; x <= width; x++)
+        sobelNormalScalar(above, row, below, x, dst);
+}
+
+// 16 inputs per row -> 8 outputs; `op` is _mm_min_epu16 or _mm_max_epu16
+#define REDUCE_2X2_SSE41(op)                                                       \
+    const __m128i low = _mm_set1_epi32(0xFFFF);                                    \
+    size_t i = 0;                                                                  \
+    for (; i + 8 <= count; i += 8) {                                               \
+        __m128i m0 = op(_mm_loadu_si128((const __m128i*)(src0 + 2 * i)),           \
+                        _mm_loadu_si128((const __m128i*)(src1 + 2 * i)));          \
+        __m128i m1 = op(_mm_loadu_si128((const __m128i*)(src0 + 2 * i + 8)),       \
+                        _mm_loadu_si128((const __m128i*)(src1 + 2 * i + 8)));      \
+        m0 = _mm_and_si128(op(m0, _mm_srli_epi32(m0, 16)), low);                   \
+        m1 = _mm_and_si128(op(m1, _mm_srli_epi32(m1, 16)), low);                   \
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi32(m0, m1));           \
+    }
+
+__attribute__((target("sse4.1")))
+static void reduceMin2x2Sse41(const unsigned short* src0, const unsigned short* src1,
+                              size_t count, unsigned short* dst)
+{
+    REDUCE_2X2_SSE41(_mm_min_epu16)
+    reduceMin2x2Scalar(src0 + 2 * i, src1 + 2 * i, count - i, dst + i);
+}
+
+__attribute__((target("sse4.1")))
+static void reduceMax2x2Sse41(const unsigned short* src0, const unsigned short* src1,
+                              size_t count, unsigned short* dst)
+{
+    REDUCE_2X2_SSE41(_mm_max_epu16)
+    reduceMax2x2Scalar(src0 + 2 * i, src1 + 2 * i, count - i, dst + i);
+}
+
+// the sum of a row's texels 2i and 2i + 1 in 32-bit lane i
+__attribute__((target("sse4.1")))
+static inline __m128i pairSums(__m128i v)
+{
+    return _mm_add_epi32(_mm_and_si128(v, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(v, 16));
+}
+
+__attribute__((target("sse4.1")))
+static void boxFilter2x2Sse41(const unsigned short* src0, const unsigned short* src1,
+                              size_t count, unsigned short* dst)
+{
+    const __m128i two = _mm_set1_epi32(2);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i m0 = _mm_add_epi32(pairSums(_mm_loadu_si128((const __m128i*)(src0 + 2 * i))),
+                                   pairSums(_mm_loadu_si128((const __m128i*)(src1 + 2 * i))));
+        __m128i m1 = _mm_add_epi32(pairSums(_mm_loadu_si128((const __m128i*)(src0 + 2 * i + 8))),
+                                   pairSums(_mm_loadu_si128((const __m128i*)(src1 + 2 * i + 8))));
+        m0 = _mm_srli_epi32(_mm_add_epi32(m0, two), 2);
+        m1 = _mm_srli_epi32(_mm_add_epi32(m1, two), 2);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi32(m0, m1));
+    }
+    boxFilter2x2Scalar(src0 + 2 * i, src1 + 2 * i, count - i, dst + i);
+}
+
+// (|sum| + 2) / 4 with the sign of sum, for 16-bit lanes
+__attribute__((target("sse4.1")))
+static inline __m128i roundQuarter(__m128i sum)
+{
+    return _mm_sign_epi16(_mm_srli_epi16(_mm_add_epi16(_mm_abs_epi16(sum), _mm_set1_epi16(2)), 2), sum);
+}
+
+__attribute__((target("sse4.1")))
+static void boxFilterPairs2x2Sse41(const signed char* src0, const signed char* src1,
+                                   size_t count, signed char* dst)
+{
+    // 8 pairs per row -> 4; each 32-bit lane holds one pair widened to i16
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i r0 = _mm_loadu_si128((const __m128i*)(src0 + 4 * i));
+        __m128i r1 = _mm_loadu_si128((const __m128i*)(src1 + 4 * i));
+        __m128 lo = _mm_castsi128_ps(_mm_add_epi16(_mm_cvtepi8_epi16(r0), _mm_cvtepi8_epi16(r1)));
+        __m128 hi = _mm_castsi128_ps(_mm_add_epi16(_mm_cvtepi8_epi16(_mm_srli_si128(r0, 8)),
+                                                   _mm_cvtepi8_epi16(_mm_srli_si128(r1, 8))));
+        __m128i even = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i mean = roundQuarter(_mm_add_epi16(even, odd));
+        _mm_storel_epi64((__m128i*)(dst + 2 * i), _mm_packs_epi16(mean, mean));
+    }
+    boxFilterPairs2x2Scalar(src0 + 4 * i, src1 + 4 * i, count - i, dst + 2 * i);
+}
+
+// --- AVX2 ---
+
+// two 16-byte loads, one per 128-bit lane
+__attribute__((target("avx2")))
+static inline __m256i loadLanes(const unsigned char* lo, const unsigned char* hi)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)lo)),
+                                   _mm_loadu_si128((const __m128i*)hi), 1);
+}
+
+__attribute__((target("avx2")))
+static void extractHeights16Avx2(const unsigned char* src, int channels, int channel,
+                                 size_t count, unsigned short* dst)
+{
+    __m128i mask128 = channelMask(channels, channel);
+    __m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(mask128), mask128, 1);
+    size_t bytes = count * channels, i = 0;
+    for (; channels <= 4 && (i + 12) * channels + 16 <= bytes; i += 16) {
+        const unsigned char* p = src + i * channels;
+        // each lane keeps 4 results in its low 8 bytes; gather qwords 0 and 2
+        __m256i a = _mm256_shuffle_epi8(loadLanes(p, p + 4 * channels), mask);
+        __m256i b = _mm256_shuffle_epi8(loadLanes(p + 8 * channels, p + 12 * channels), mask);
+        __m256i v = _mm256_unpacklo_epi64(a, b);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(v, 0xD8));
+    }
+    extractHeights16Scalar(src + i * channels, channels, channel, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void convertHeightsFloatAvx2(const unsigned short* src, size_t count, float scale,
+                                    float bias, float* dst)
+{
+    __m256 s = _mm256_set1_ps(scale), b = _mm256_set1_ps(bias);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v), s), b));
+    }
+    convertHeightsFloatScalar(src + i, count - i, scale, bias, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void sobelNormalRowAvx2(const float* above, const float* row, const float* below,
+                               int width, signed char* dst)
+{
+    const __m256 two = _mm256_set1_ps(2.0f), eighth = _mm256_set1_ps(0.125f);
+    const __m256 one = _mm256_set1_ps(1.0f), snorm = _mm256_set1_ps(127.0f);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    int x = 1;
+    for (; x + 7 <= width; x += 8) {
+        __m256 a0 = _mm256_loadu_ps(above + x - 1), a1 = _mm256_loadu_ps(above + x), a2 = _mm256_loadu_ps(above + x + 1);
+        __m256 r0 = _mm256_loadu_ps(row + x - 1), r2 = _mm256_loadu_ps(row + x + 1);
+        __m256 b0 = _mm256_loadu_ps(below + x - 1), b1 = _mm256_loadu_ps(below + x), b2 = _mm256_loadu_ps(below + x + 1);
+
+        __m256 dx = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(a2, _mm256_mul_ps(two, r2)), b2),
+                                  _mm256_add_ps(_mm256_add_ps(a0, _mm256_mul_ps(two, r0)), b0));
+        __m256 dz = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(b0, _mm256_mul_ps(two, b1)), b2),
+                                  _mm256_add_ps(_mm256_add_ps(a0, _mm256_mul_ps(two, a1)), a2));
+        dx = _mm256_mul_ps(dx, eighth);
+        dz = _mm256_mul_ps(dz, eighth);
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), one), _mm256_mul_ps(dz, dz)));
+        __m256 inv = _mm256_div_ps(one, len);
+        __m256i nx = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_mul_ps(_mm256_xor_ps(dx, sign), inv), snorm));
+        __m256i nz = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_mul_ps(_mm256_xor_ps(dz, sign), inv), snorm));
+
+        // per lane: (x, z) pairs in order, packed to i8 in the low qword
+        __m256i pairs = _mm256_packs_epi32(_mm256_unpacklo_epi32(nx, nz), _mm256_unpackhi_epi32(nx, nz));
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packs_epi16(pairs, pairs), 0x08);
+        _mm_storeu_si128((__m128i*)(dst + 2 * x - 2), _mm256_castsi256_si128(bytes));
+    }
+    for (; x <= width; x++)
+        sobelNormalScalar(above, row, below, x, dst);
+}
+
+// 32 inputs per row -> 16 outputs; packus works per lane, so fix the qword order
+#define REDUCE_2X2_AVX2(op)                                                        \
+    const __m256i low = _mm256_set1_epi32(0xFFFF);                                 \
+    size_t i = 0;                                                                  \
+    for (; i + 16 <= count; i += 16) {                                             \
+        __m256i m0 = op(_mm256_loadu_si256((const __m256i*)(src0 + 2 * i)),        \
+                        _mm256_loadu_si256((const __m256i*)(src1 + 2 * i)));       \
+        __m256i m1 = op(_mm256_loadu_si256((const __m256i*)(src0 + 2 * i + 16)),   \
+                        _mm256_loadu_si256((const __m256i*)(src1 + 2 * i + 16)));  \
+        m0 = _mm256_and_si256(op(m0, _mm256_srli_epi32(m0, 16)), low);             \
+        m1 = _mm256_and_si256(op(m1, _mm256_srli_epi32(m1, 16)), low);             \
+        __m256i packed = _mm256_packus_epi32(m0, m1);                              \
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(packed, 0xD8)); \
+    }
+
+__attribute__((target("avx2")))
+static void reduceMin2x2Avx2(const unsigned short* src0, const unsigned short* src1,
+                             size_t count, unsigned short* dst)
+{
+    REDUCE_2X2_AVX2(_mm256_min_epu16)
+    reduceMin2x2Scalar(src0 + 2 * i, src1 + 2 * i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void reduceMax2x2Avx2(const unsigned short* src0, const unsigned short* src1,
+                             size_t count, unsigned short* dst)
+{
+    REDUCE_2X2_AVX2(_mm256_max_epu16)
+    reduceMax2x2Scalar(src0 + 2 * i, src1 + 2 * i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i pairSums(__m256i v)
+{
+    return _mm256_add_epi32(_mm256_and_si256(v, _mm256_set1_epi32(0xFFFF)), _mm256_srli_epi32(v, 16));
+}
+
+__attribute__((target("avx2")))
+static void boxFilter2x2Avx2(const unsigned short* src0, const unsigned short* src1,
+                             size_t count, unsigned short* dst)
+{
+    const __m256i two = _mm256_set1_epi32(2);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i m0 = _mm256_add_epi32(pairSums(_mm256_loadu_si256((const __m256i*)(src0 + 2 * i))),
+                                      pairSums(_mm256_loadu_si256((const __m256i*)(src1 + 2 * i))));
+        __m256i m1 = _mm256_add_epi32(pairSums(_mm256_loadu_si256((const __m256i*)(src0 + 2 * i + 16))),
+                                      pairSums(_mm256_loadu_si256((const __m256i*)(src1 + 2 * i + 16))));
+        m0 = _mm256_srli_epi32(_mm256_add_epi32(m0, two), 2);
+        m1 = _mm256_srli_epi32(_mm256_add_epi32(m1, two), 2);
+        // packus works per lane, so fix the qword order
+        __m256i packed = _mm256_packus_epi32(m0, m1);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    boxFilter2x2Scalar(src0 + 2 * i, src1 + 2 * i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i roundQuarter(__m256i sum)
+{
+    return _mm256_sign_epi16(_mm256_srli_epi16(_mm256_add_epi16(_mm256_abs_epi16(sum), _mm256_set1_epi16(2)), 2),
+                             sum);
+}
+
+__attribute__((target("avx2")))
+static void boxFilterPairs2x2Avx2(const signed char* src0, const signed char* src1,
+                                  size_t count, signed char* dst)
+{
+    // 16 pairs per row -> 8; shuffle_ps works per lane, so lane 0 ends up
+    // with outputs 0, 1, 4, 5 and lane 1 with 2, 3, 6, 7
+    const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i r0 = _mm256_loadu_si256((const __m256i*)(src0 + 4 * i));
+        __m256i r1 = _mm256_loadu_si256((const __m256i*)(src1 + 4 * i));
+        __m256 lo = _mm256_castsi256_ps(_mm256_add_epi16(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(r0)),
+                                                         _mm256_cvtepi8_epi16(_mm256_castsi256_si128(r1))));
+        __m256 hi = _mm256_castsi256_ps(_mm256_add_epi16(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(r0, 1)),
+                                                         _mm256_cvtepi8_epi16(_mm256_extracti128_si256(r1, 1))));
+        __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256i mean = _mm256_permutevar8x32_epi32(roundQuarter(_mm256_add_epi16(even, odd)), order);
+        __m128i bytes = _mm_packs_epi16(_mm256_castsi256_si128(mean), _mm256_extracti128_si256(mean, 1));
+        _mm_storeu_si128((__m128i*)(dst + 2 * i), bytes);
+    }
+    boxFilterPairs2x2Scalar(src0 + 4 * i, src1 + 4 * i, count - i, dst + 2 * i);
+}
+
+#endif // HEIGHT_KERNELS_X86
+
+struct HeightKernels {
+    const char* isa;
+    void (*extractHeights16)(const unsigned char*, int, int, size_t, unsigned short*);
+    void (*convertHeightsFloat)(const unsigned short*, size_t, float, float, float*);
+    void (*sobelNormalRow)(const float*, const float*, const float*, int, signed char*);
+    void (*reduceMin2x2)(const unsigned short*, const unsigned short*, size_t, unsigned short*);
+    void (*reduceMax2x2)(const unsigned short*, const unsigned short*, size_t, unsigned short*);
+    void (*boxFilter2x2)(const unsigned short*, const unsigned short*, size_t, unsigned short*);
+    void (*boxFilterPairs2x2)(const signed char*, const signed char*, size_t, signed char*);
+};
+
+static HeightKernels pickKernels()
+{
+#ifdef HEIGHT_KERNELS_X86
+    if (__builtin_cpu_supports("avx2"))
+        return { "AVX2", extractHeights16Avx2, convertHeightsFloatAvx2,
+                 sobelNormalRowAvx2, reduceMin2x2Avx2, reduceMax2x2Avx2,
+                 boxFilter2x2Avx2, boxFilterPairs2x2Avx2 };
+    if (__builtin_cpu_supports("sse4.1"))
+        return { "SSE4.1", extractHeights16Sse41, convertHeightsFloatSse41,
+                 sobelNormalRowSse41, reduceMin2x2Sse41, reduceMax2x2Sse41,
+                 boxFilter2x2Sse41, boxFilterPairs2x2Sse41 };
+#endif
+    return { "scalar", extractHeights16Scalar, convertHeightsFloatScalar,
+             sobelNormalRowScalar, reduceMin2x2Scalar, reduceMax2x2Scalar,
+             boxFilter2x2Scalar, boxFilterPairs2x2Scalar };
+}
+
+static const HeightKernels& kernels()
+{
+    static const HeightKernels table = pickKernels();
+    return table;
+}
+
+const char* heightKernelIsa()
+{
+    return kernels().isa;
+}
+
+void extractHeights16(const unsigned char* src, int channels, int channel, size_t count,
+                      unsigned short* dst)
+{
+    kernels().extractHeights16(src, channels, channel, count, dst);
+}
+
+void convertHeightsFloat(const unsigned short* src, size_t count, float scale, float bias,
+                         float* dst)
+{
+    kernels().convertHeightsFloat(src, count, scale, bias, dst);
+}
+
+void sobelNormalRow(const float* above, const float* row, const float* below, int width,
+                    signed char* dst)
+{
+    kernels().sobelNormalRow(above, row, below, width, dst);
+}
+
+void reduceMin2x2(const unsigned short* src0, const unsigned short* src1, size_t count,
+                  unsigned short* dst)
+{
+    kernels().reduceMin2x2(src0, src1, count, dst);
+}
+
+void reduceMax2x2(const unsigned short* src0, const unsigned short* src1, size_t count,
+                  unsigned short* dst)
+{
+    kernels().reduceMax2x2(src0, src1, count, dst);
+}
+
+void boxFilter2x2(const unsigned short* src0, const unsigned short* src1, size_t count,
+                  unsigned short* dst)
+{
+    kernels().boxFilter2x2(src0, src1, count, dst);
+}
+
+void boxFilterPairs2x2(const signed char* src0, const signed char* src1, size_t count,
+                       signed char* dst)
+{
+    kernels().boxFilterPairs2x2(src0, src1, count, dst);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+
+// CPU kernels behind every heightmap-derived product baked at load time.
+// Each has AVX2, SSE4.1 and scalar variants; the best one the CPU supports
+// is picked from CPUID on first use. All variants give identical results.
+// Callers work row by row and keep edge handling to themselves.
+
+// "AVX2", "SSE4.1" or "scalar"
+const char* heightKernelIsa();
+
+// Channel `channel` of `count` interleaved 8-bit texels (`channels` each),
+// widened to 16-bit normalized (v * 257, exact).
+void extractHeights16(const unsigned char* src, int channels, int channel, size_t count,
+                      unsigned short* dst);
+
+// `count` 16-bit heights as v * scale + bias.
+void convertHeightsFloat(const unsigned short* src, size_t count, float scale, float bias,
+                         float* dst);
+
+// Sobel-filtered normals of a row of `width` texels. The three rows hold
+// heights in world units (one unit per texel) and are padded to width + 2
+// with a clamped texel at either end. Writes the normal's (x, z) as snorm8
+// pairs, dst[2 * x] and dst[2 * x + 1] for column x.
+void sobelNormalRow(const float* above, const float* row, const float* below, int width,
+                    signed char* dst);
+
+// dst[i] = min / max of src0[2i], src0[2i + 1], src1[2i], src1[2i + 1]:
+// one row of a 2x2 min or max reduction, `count` outputs.
+void reduceMin2x2(const unsigned short* src0, const unsigned short* src1, size_t count,
+                  unsigned short* dst);
+void reduceMax2x2(const unsigned short* src0, const unsigned short* src1, size_t count,
+                  unsigned short* dst);
+
+// dst[i] = (src0[2i] + src0[2i + 1] + src1[2i] + src1[2i + 1] + 2) / 4:
+// one row of a 2x2 box filter, rounding like glGenerateMipmap, `count`
+// outputs.
+void boxFilter2x2(const unsigned short* src0, const unsigned short* src1, size_t count,
+                  unsigned short* dst);
+// The same over `count` snorm8 (x, z) pairs, like sobelNormalRow() writes:
+// dst[2i + c] is the mean of src0[4i + c], src0[4i + 2 + c], src1[4i + c]
+// and src1[4i + 2 + c], rounded half away from zero.
+void boxFilterPairs2x2(const signed char* src0, const signed char* src1, size_t count,
+                       signed char* dst);
@@ -0,0 +1,175 @@
+#include "height_pyramid.hpp"
+
+#include "height_kernels.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+const char* HEIGHT_PYRAMID_GLSL = R"(
+uniform sampler2D heightPyramid;
+
+vec2 heightBounds(vec2 uv0, vec2 uv1)
+{
+  ivec2 size = textureSize(heightPyramid, 0);
+  ivec2 t0 = clamp(ivec2(floor(uv0 * vec2(size) - 0.5)), ivec2(0), size - 1);
+  ivec2 t1 = clamp(ivec2(ceil(uv1 * vec2(size) - 0.5)), ivec2(0), size - 1);
+  int extent = max(t1.x - t0.x, t1.y - t0.y) + 1;
+  int level = min(int(ceil(log2(float(extent)))), textureQueryLevels(heightPyramid) - 1);
+
+  ivec2 last = textureSize(heightPyramid, level) - 1;
+  ivec2 a = min(t0 >> level, last);
+  ivec2 b = min(t1 >> level, last);
+  vec2 r00 = texelFetch(heightPyramid, a, level).rg;
+  vec2 r10 = texelFetch(heightPyramid, ivec2(b.x, a.y), level).rg;
+  vec2 r01 = texelFetch(heightPyramid, ivec2(a.x, b.y), level).rg;
+  vec2 r11 = texelFetch(heightPyramid, b, level).rg;
+  vec2 r = vec2(min(min(r00.x, r10.x), min(r01.x, r11.x)),
+                max(max(r00.y, r10.y), max(r01.y, r11.y)));
+  return r * 64.0 - 16.0;
+}
+)";
+
+void HeightPyramid::build(const unsigned short* heights, int w, int h)
+{
+    allocate(w, h);
+    buildBase(heights, 0, h);
+    for (unsigned l = 1; l < levels.size(); l++)
+        reduce(l, 0, levels[l].height);
+    std::cout << "Built height pyramid: " << levels.size() << " levels (" << heightKernelIsa() << ")" << std::endl;
+}
+
+void HeightPyramid::allocate(int w, int h)
+{
+    width = w;
+    height = h;
+    levels.clear();
+    for (;;) {
+        Level level;
+        level.width = levels.empty() ? w : std::max(1, levels.back().width / 2);
+        level.height = levels.empty() ? h : std::max(1, levels.back().height / 2);
+        level.lo.assign((size_t)level.width * level.height, 65535);
+        level.hi.assign((size_t)level.width * level.height, 0);
+        levels.push_back(std::move(level));
+        if (levels.back().width == 1 && levels.back().height == 1)
+            break;
+    }
+}
+
+void HeightPyramid::buildBase(const unsigned short* heights, int y0, int y1)
+{
+    Level& base = levels[0];
+    size_t first = (size_t)y0 * width, count = (size_t)(y1 - y0) * width;
+    std::copy(heights + first, heights + first + count, base.lo.begin() + first);
+    std::copy(heights + first, heights + first + count, base.hi.begin() + first);
+}
+
+void HeightPyramid::reduce(unsigned level, int y0, int y1)
+{
+    const Level& src = levels[level - 1];
+    Level& dst = levels[level];
+
+    // the last row/column also takes the odd remainder (or the whole
+    // source when it is a single texel wide)
+    auto fold = [&](int x, int y, int sx0, int sx1, int sy0, int sy1) {
+        size_t out = (size_t)y * dst.width + x;
+        for (int sy = sy0; sy <= sy1; sy++) {
+            for (int sx = sx0; sx <= sx1; sx++) {
+                dst.lo[out] = std::min(dst.lo[out], src.lo[(size_t)sy * src.width + sx]);
+                dst.hi[out] = std::max(dst.hi[out], src.hi[(size_t)sy * src.width + sx]);
+            }
+        }
+    };
+
+    int pairs = src.width / 2;
+    for (int y = y0; y < y1; y++) {
+        // full 2x2 blocks with the kernels
+        size_t row0 = (size_t)std::min(2 * y, src.height - 1) * src.width;
+        size_t row1 = (size_t)std::min(2 * y + 1, src.height - 1) * src.width;
+        size_t out = (size_t)y * dst.width;
+        reduceMin2x2(&src.lo[row0], &src.lo[row1], pairs, &dst.lo[out]);
+        reduceMax2x2(&src.hi[row0], &src.hi[row1], pairs, &dst.hi[out]);
+
+        bool lastRow = y == dst.height - 1;
+        if (src.width % 2 || !pairs)
+            fold(dst.width - 1, y, 2 * pairs, src.width - 1,
+                 2 * y, lastRow ? src.height - 1 : 2 * y + 1);
+        if (lastRow && src.height % 2 && src.height > 1)
+            for (int x = 0; x < dst.width; x++)
+                fold(x, y, 2 * x, x == dst.width - 1 ? src.width - 1 : 2 * x + 1,
+                     src.height - 1, src.height - 1);
+    }
+}
+
+glm::vec2 HeightPyramid::bounds(int x0, int y0, int x1, int y1) const
+{
+    x0 = std::clamp(x0, 0, width - 1);
+    x1 = std::clamp(x1, 0, width - 1);
+    y0 = std::clamp(y0, 0, height - 1);
+    y1 = std::clamp(y1, 0, height - 1);
+
+    int extent = std::max(x1 - x0, y1 - y0) + 1;
+    unsigned level = 0;
+    while ((1 << level) < extent)
+        level++;
+    level = std::min(level, (unsigned)levels.size() - 1);
+
+    const Level& l = levels[level];
+    int ax = std::min(x0 >> level, l.width - 1), bx = std::min(x1 >> level, l.width - 1);
+    int ay = std::min(y0 >> level, l.height - 1), by = std::min(y1 >> level, l.height - 1);
+    unsigned short lo = 65535, hi = 0;
+    for (int y = ay; y <= by; y++) {
+        for (int x = ax; x <= bx; x++) {
+            lo = std::min(lo, l.lo[(size_t)y * l.width + x]);
+            hi = std::max(hi, l.hi[(size_t)y * l.width + x]);
+        }
+    }
+    return glm::vec2(lo, hi) / 65535.0f * HEIGHT_SCALE + HEIGHT_OFFSET;
+}
+
+glm::vec2 HeightPyramid::boundsUV(glm::vec2 uv0, glm::vec2 uv1) const
+{
+    return bounds((int)std::floor(uv0.x * width - 0.5f), (int)std::floor(uv0.y * height - 0.5f),
+                  (int)std::ceil(uv1.x * width - 0.5f), (int)std::ceil(uv1.y * height - 0.5f));
+}
+
+TextureLayout HeightPyramid::layout() const
+{
+    TextureLayout layout;
+    layout.format = GL_RG16;
+    layout.width = width;
+    layout.height = height;
+    layout.levels = (unsigned)levels.size();
+    return layout;
+}
+
+std::vector<unsigned char> HeightPyramid::pack() const
+{
+    TextureLayout packed = layout();
+    std::vector<unsigned char> data(packed.dataSize());
+    for (unsigned l = 0; l < levels.size(); l++) {
+        unsigned short* rg = (unsigned short*)(data.data() + packed.imageOffset(l, 0));
+        for (size_t t = 0; t < levels[l].lo.size(); t++) {
+            rg[2 * t] = levels[l].lo[t];
+            rg[2 * t + 1] = levels[l].hi[t];
+        }
+    }
+    return data;
+}
+
+bool HeightPyramid::unpack(const TextureLayout& packed, const unsigned char* data)
+{
+    allocate(packed.width, packed.height);
+    if (packed.format != GL_RG16 || packed.levels != levels.size())
+        return false;
+    for (unsigned l = 0; l < levels.size(); l++) {
+        const unsigned short* rg = (const unsigned short*)(data + packed.imageOffset(l, 0));
+        for (size_t t = 0; t < levels[l].lo.size(); t++) {
+            levels[l].lo[t] = rg[2 * t];
+            levels[l].hi[t] = rg[2 * t + 1];
+        }
+    }
+    return true;
+}
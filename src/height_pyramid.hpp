@@ -0,0 +1,64 @@
+#pragma once
+
+#include "texture_layout.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// World height = normalized heightmap sample * HEIGHT_SCALE + HEIGHT_OFFSET,
+// as displaced by the TES.
+const float HEIGHT_SCALE = 64.0f;
+const float HEIGHT_OFFSET = -16.0f;
+
+// Min/max mip pyramid of the heightmap. Level 0 holds the texels themselves,
+// every level above halves the resolution (GL mip sizes) and a texel on the
+// last row/column also absorbs the remainder of an odd-sized level below, so
+// each level covers the whole map. Values are 16-bit normalized, which is
+// exact for 8-bit and 16-bit sources alike.
+//
+// Any rectangle spans at most 2x2 texels of the level whose texels are at
+// least as large as the rectangle, so bounds() costs four lookups whatever
+// the size; the result is conservative.
+class HeightPyramid {
+public:
+  // 16-bit normalized heights, as uploaded for the TES.
+  void build(const unsigned short* heights, int width, int height);
+
+  // build() in pieces, for tiled jobs: allocate() sizes every level, then
+  // buildBase() fills rows [y0, y1) of level 0 and reduce() rows [y0, y1)
+  // of `level` from level - 1. Row y of a level reads rows 2y and 2y + 1 of
+  // the one below, plus the odd remainder on the last row.
+  void allocate(int width, int height);
+  void buildBase(const unsigned short* heights, int y0, int y1);
+  void reduce(unsigned level, int y0, int y1);
+
+  // (min, max) world height over texels [x0, x1] x [y0, y1], inclusive.
+  glm::vec2 bounds(int x0, int y0, int x1, int y1) const;
+  // (min, max) world height over everything bilinear filtering can reach
+  // from inside the texture-space rectangle [uv0, uv1].
+  glm::vec2 boundsUV(glm::vec2 uv0, glm::vec2 uv1) const;
+
+  // The whole chain as GL_RG16 mip levels (min in r, max in g), for
+  // uploadTexture(); unpack() restores the pyramid from such data.
+  TextureLayout layout() const;
+  std::vector<unsigned char> pack() const;
+  bool unpack(const TextureLayout& layout, const unsigned char* data);
+
+  int width = 0, height = 0;
+  unsigned levelCount() const { return (unsigned)levels.size(); }
+  int levelWidth(unsigned level) const { return levels[level].width; }
+  int levelHeight(unsigned level) const { return levels[level].height; }
+
+private:
+  struct Level {
+    int width, height;
+    std::vector<unsigned short> lo, hi;
+  };
+
+  std::vector<Level> levels;
+};
+
+// GLSL counterpart of HeightPyramid::boundsUV for the texture of pack(),
+// uploaded unfiltered; declares `uniform sampler2D heightPyramid`.
+extern const char* HEIGHT_PYRAMID_GLSL;
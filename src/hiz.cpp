@@ -0,0 +1,142 @@
+#include "hiz.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+const char* HIZ_GLSL = R"(
+uniform sampler2D hiZ;
+uniform mat4 hiZViewProjection; // the frame hiZ was built from
+uniform ivec2 hiZPixels;        // its depth buffer size
+
+// True if the box lay entirely behind that frame's depth. Boxes crossing
+// the near plane or the screen edge were not fully covered by it, so they
+// count as visible.
+bool boxOccluded(vec3 lo, vec3 hi)
+{
+  vec3 s0 = vec3(1.0), s1 = vec3(0.0);
+  for (int i = 0; i < 8; i++) {
+    vec4 c = hiZViewProjection * vec4(mix(lo, hi, vec3(i & 1, (i >> 1) & 1, i >> 2)), 1.0);
+    if (c.w <= 0.0)
+      return false;
+    vec3 p = c.xyz / c.w * 0.5 + 0.5;
+    s0 = min(s0, p);
+    s1 = max(s1, p);
+  }
+  if (any(lessThan(s0.xy, vec2(0.0))) || any(greaterThan(s1.xy, vec2(1.0))))
+    return false;
+
+  // the level where the rectangle spans at most 2x2 texels; level l
+  // texels cover 2^(l+1) pixels
+  ivec2 p0 = min(ivec2(s0.xy * vec2(hiZPixels)), hiZPixels - 1);
+  ivec2 p1 = min(ivec2(s1.xy * vec2(hiZPixels)), hiZPixels - 1);
+  int extent = max(p1.x - p0.x, p1.y - p0.y) + 1;
+  int level = clamp(int(ceil(log2(float(extent)))) - 1, 0, textureQueryLevels(hiZ) - 1);
+
+  ivec2 last = max(textureSize(hiZ, 0) >> level, ivec2(1)) - 1; // GL mip sizes
+  ivec2 a = min(p0 >> (level + 1), last);
+  ivec2 b = min(p1 >> (level + 1), last);
+  float depth = max(max(texelFetch(hiZ, a, level).r, texelFetch(hiZ, ivec2(b.x, a.y), level).r),
+                    max(texelFetch(hiZ, ivec2(a.x, b.y), level).r, texelFetch(hiZ, b, level).r));
+  return s0.z > depth;
+}
+)";
+
+const char* CS_HIZ_REDUCE = R"(
+#version 450 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32f) writeonly uniform image2D dst;
+uniform sampler2D src; // depth for level 0, the pyramid otherwise
+uniform int srcLevel;
+
+void main(){
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  ivec2 size = imageSize(dst);
+  if (texel.x >= size.x || texel.y >= size.y)
+    return;
+  // the 2x2 below, plus the odd row / column left over on the last texel
+  ivec2 srcSize = textureSize(src, srcLevel);
+  ivec2 p0 = texel * 2;
+  ivec2 p1 = min(p0 + 1, srcSize - 1);
+  if (texel.x == size.x - 1)
+    p1.x = srcSize.x - 1;
+  if (texel.y == size.y - 1)
+    p1.y = srcSize.y - 1;
+  float depth = 0.0;
+  for (int y = p0.y; y <= p1.y; y++)
+    for (int x = p0.x; x <= p1.x; x++)
+      depth = max(depth, texelFetch(src, ivec2(x, y), srcLevel).r);
+  imageStore(dst, texel, vec4(depth));
+}
+)";
+
+bool HiZBuffer::init(int w, int h)
+{
+    if (!reduceProgram.link({{GL_COMPUTE_SHADER, CS_HIZ_REDUCE}}))
+        return false;
+    reduceProgram.use();
+    glUniform1i(reduceProgram.uniform("src"), HIZ_TEXTURE_UNIT);
+    glUniform1i(reduceProgram.uniform("dst"), 0);
+    resize(w, h);
+    return true;
+}
+
+void HiZBuffer::resize(int w, int h)
+{
+    if (w == width && h == height)
+        return;
+    glDeleteTextures(1, &depth);
+    glDeleteTextures(1, &hiz);
+    width = std::max(w, 1);
+    height = std::max(h, 1);
+    // half the depth's size at level 0, down to 1x1
+    levels = 1;
+    while ((width >> (levels + 1)) > 0 || (height >> (levels + 1)) > 0)
+        levels++;
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &depth);
+    glTextureStorage2D(depth, 1, GL_DEPTH_COMPONENT24, width, height);
+    glTextureParameteri(depth, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(depth, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &hiz);
+    glTextureStorage2D(hiz, levels, GL_R32F, std::max(width / 2, 1), std::max(height / 2, 1));
+    glTextureParameteri(hiz, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTextureParameteri(hiz, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    built = false;
+
+    std::cout << "Hi-Z pyramid " << std::max(width / 2, 1) << "x" << std::max(height / 2, 1) << ", " << levels
+              << " levels" << std::endl;
+}
+
+void HiZBuffer::build()
+{
+    glCopyTextureSubImage2D(depth, 0, 0, 0, 0, 0, width, height);
+
+    // level 0 halves the depth; level l reads level l - 1 of the same
+    // texture while writing its own
+    reduceProgram.use();
+    glActiveTexture(GL_TEXTURE0 + HIZ_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    for (int l = 0; l < levels; l++) {
+        if (l == 1)
+            glBindTexture(GL_TEXTURE_2D, hiz);
+        glUniform1i(reduceProgram.uniform("srcLevel"), std::max(l - 1, 0));
+        glBindImageTexture(0, hiz, l, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((std::max(width >> (l + 1), 1) + 7) / 8, (std::max(height >> (l + 1), 1) + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+    // left bound for the culler
+    glActiveTexture(GL_TEXTURE0);
+    built = true;
+}
+
+void HiZBuffer::destroy()
+{
+    reduceProgram.destroy();
+    glDeleteTextures(1, &depth);
+    glDeleteTextures(1, &hiz);
+    depth = hiz = 0;
+    width = height = levels = 0;
+    built = false;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "shader.hpp"
+
+// Hierarchical depth buffer: a GL_R32F mip chain of the last frame's depth
+// where every texel holds the farthest depth of the pixels it covers. Level
+// 0 is half the depth's size and every level above halves again like GL
+// mips; a texel on the last row/column also covers the odd remainder of the
+// level below, so level l texel (x, y) covers pixels
+// [x << (l + 1), (x + 1) << (l + 1)) plus that remainder.
+//
+// build() copies the depth of the read framebuffer (the default one or the
+// benchmark target alike) and reduces it with one compute dispatch per
+// level; the GPU culler tests patches against it a frame later.
+class HiZBuffer {
+public:
+  bool init(int width, int height);
+  // Reallocates for a new viewport size; the next build() fills it.
+  void resize(int width, int height);
+  void build();
+  void destroy();
+
+  unsigned int texture() const { return hiz; }
+  glm::ivec2 pixels() const { return glm::ivec2(width, height); }
+  bool valid() const { return built; }
+
+private:
+  ShaderProgram reduceProgram;
+  unsigned int depth = 0, hiz = 0;
+  int width = 0, height = 0;
+  int levels = 0;
+  bool built = false;
+};
+
+// Texture unit build() leaves the pyramid bound to for the culler.
+const int HIZ_TEXTURE_UNIT = 8;
+
+// boxOccluded(lo, hi): whether a world-space box was hidden behind the
+// pyramid's frame; declares `uniform sampler2D hiZ` and
+// `uniform mat4 hiZViewProjection`.
+extern const char* HIZ_GLSL;
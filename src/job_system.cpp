@@ -0,0 +1,224 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+struct Job {
+  std::function<void()> fn;
+  const char* stage = nullptr;
+  std::atomic<int> pending{1};   // unfinished deps, +1 until submit() is done
+  std::mutex mutex;              // guards done / continuations
+  bool done = false;
+  std::vector<JobHandle> continuations;
+  JobHandle self;                // keeps a queued job alive until it ran
+};
+
+// index of the current worker's queue, -1 on other threads
+static thread_local int workerIndex = -1;
+
+JobSystem::JobSystem(unsigned threads)
+{
+    created = std::chrono::steady_clock::now();
+    if (threads == 0) {
+        unsigned hardware = std::thread::hardware_concurrency();
+        threads = hardware > 1 ? hardware - 1 : 1;
+    }
+    for (unsigned i = 0; i < threads; i++)
+        queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < threads; i++)
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    sleepCv.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+JobHandle JobSystem::submit(std::function<void()> fn, std::vector<JobHandle> deps, const char* stage)
+{
+    JobHandle job = std::make_shared<Job>();
+    job->fn = std::move(fn);
+    job->stage = stage;
+    job->self = job;
+    submitted.fetch_add(1, std::memory_order_relaxed);
+    for (const JobHandle& dep : deps) {
+        if (!dep)
+            continue;
+        std::lock_guard<std::mutex> lock(dep->mutex);
+        if (!dep->done) {
+            job->pending++;
+            dep->continuations.push_back(job);
+        }
+    }
+    if (--job->pending == 0)
+        enqueue(job.get());
+    return job;
+}
+
+std::vector<JobHandle> JobSystem::parallelFor(int begin, int end, int grain,
+                                              std::function<void(int, int)> fn,
+                                              std::vector<JobHandle> deps, const char* stage)
+{
+    std::vector<JobHandle> jobs;
+    grain = std::max(grain, 1);
+    for (int first = begin; first < end; first += grain) {
+        int last = std::min(first + grain, end);
+        jobs.push_back(submit([fn, first, last]() { fn(first, last); }, deps, stage));
+    }
+    return jobs;
+}
+
+JobHandle JobSystem::after(std::vector<JobHandle> deps)
+{
+    return submit([]() {}, std::move(deps));
+}
+
+void JobSystem::enqueue(Job* job)
+{
+    unsigned index = workerIndex >= 0 ? (unsigned)workerIndex
+                                      : nextQueue++ % (unsigned)workers.size();
+    // count first so a concurrent take() never drives `queued` negative
+    queued++;
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->jobs.push_back(job);
+    }
+    // taking sleepMutex orders this against a worker about to sleep
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    sleepCv.notify_one();
+}
+
+Job* JobSystem::take(unsigned self)
+{
+    if (self < queues.size()) {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            Job* job = own.jobs.back();
+            own.jobs.pop_back();
+            queued--;
+            return job;
+        }
+    }
+    for (size_t i = 1; i <= queues.size(); i++) {
+        Queue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            Job* job = victim.jobs.front();
+            victim.jobs.pop_front();
+            queued--;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::run(Job* job)
+{
+    auto start = std::chrono::steady_clock::now();
+    job->fn();
+    auto end = std::chrono::steady_clock::now();
+
+    if (job->stage) {
+        using ms = std::chrono::duration<double, std::milli>;
+        double startMs = ms(start - created).count(), endMs = ms(end - created).count();
+        std::lock_guard<std::mutex> lock(timingMutex);
+        auto it = std::find_if(timings.begin(), timings.end(),
+                               [job](const StageTiming& t) { return t.name == job->stage; });
+        if (it == timings.end()) {
+            timings.push_back(StageTiming());
+            it = timings.end() - 1;
+            it->name = job->stage;
+            it->startMs = startMs;
+        }
+        it->startMs = std::min(it->startMs, startMs);
+        it->endMs = std::max(it->endMs, endMs);
+        it->busyMs += endMs - startMs;
+        it->jobs++;
+    }
+    finish(job);
+}
+
+void JobSystem::finish(Job* job)
+{
+    std::vector<JobHandle> next;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        next.swap(job->continuations);
+        job->fn = nullptr;
+    }
+    finished.fetch_add(1, std::memory_order_relaxed);
+    for (const JobHandle& cont : next)
+        if (--cont->pending == 0)
+            enqueue(cont.get());
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    sleepCv.notify_all(); // wake wait()ers
+    JobHandle keep = std::move(job->self); // may free the job on return
+}
+
+void JobSystem::workerLoop(unsigned index)
+{
+    workerIndex = (int)index;
+    for (;;) {
+        if (Job* job = take(index)) {
+            run(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCv.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
+
+void JobSystem::wait(const JobHandle& job)
+{
+    if (!job)
+        return;
+    // other threads have no queue of their own and only steal
+    unsigned self = workerIndex >= 0 ? (unsigned)workerIndex : (unsigned)queues.size();
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            if (job->done)
+                return;
+        }
+        if (Job* other = take(self)) {
+            run(other);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCv.wait_for(lock, std::chrono::milliseconds(1), [this, &job]() {
+            std::lock_guard<std::mutex> jobLock(job->mutex);
+            return job->done || queued > 0;
+        });
+    }
+}
+
+std::vector<StageTiming> JobSystem::stageTimings() const
+{
+    std::lock_guard<std::mutex> lock(timingMutex);
+    std::vector<StageTiming> sorted = timings;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const StageTiming& a, const StageTiming& b) { return a.startMs < b.startMs; });
+    return sorted;
+}
+
+std::string JobSystem::stageReport() const
+{
+    std::string report;
+    char line[160];
+    for (const StageTiming& t : stageTimings()) {
+        std::snprintf(line, sizeof(line), "  %-10s %8.1f ms wall  %8.1f ms busy  %4u jobs  (%.1f - %.1f ms)\n",
+                      t.name.c_str(), t.endMs - t.startMs, t.busyMs, t.jobs, t.startMs, t.endMs);
+        report += line;
+    }
+    return report;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Job;
+using JobHandle = std::shared_ptr<Job>;
+
+// Wall-clock span (first job start to last job end, ms since the pool was
+// created) and summed busy time of every job submitted under one stage name.
+struct StageTiming {
+  std::string name;
+  double startMs = 0.0, endMs = 0.0, busyMs = 0.0;
+  unsigned jobs = 0;
+};
+
+// Fixed pool of worker threads with one deque each. Workers pop their own
+// newest job and steal the oldest from the others when they run dry; jobs
+// submitted from a worker land on its own deque. A job becomes runnable
+// once every job it depends on has finished, so a dependency graph of tiles
+// is just a series of submit() calls. wait() runs jobs on the calling thread
+// until the handle finishes, so a pool of one worker still makes progress
+// with the main thread helping.
+class JobSystem {
+public:
+  // 0 = one worker per hardware thread, minus the main thread
+  explicit JobSystem(unsigned threads = 0);
+  ~JobSystem();
+
+  JobHandle submit(std::function<void()> fn, std::vector<JobHandle> deps = {},
+                   const char* stage = nullptr);
+  // One job per `grain` items of [begin, end): fn(first, last).
+  std::vector<JobHandle> parallelFor(int begin, int end, int grain,
+                                     std::function<void(int, int)> fn,
+                                     std::vector<JobHandle> deps = {},
+                                     const char* stage = nullptr);
+  // A job with no work that finishes once all of `deps` have.
+  JobHandle after(std::vector<JobHandle> deps);
+
+  void wait(const JobHandle& job);
+
+  unsigned threadCount() const { return (unsigned)workers.size(); }
+  // Jobs submitted and finished so far; a graph submitted up front makes
+  // their ratio a progress estimate.
+  unsigned jobsSubmitted() const { return submitted.load(std::memory_order_relaxed); }
+  unsigned jobsFinished() const { return finished.load(std::memory_order_relaxed); }
+  std::vector<StageTiming> stageTimings() const;
+  // One line per stage, in first-start order.
+  std::string stageReport() const;
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Job*> jobs;
+  };
+
+  void workerLoop(unsigned index);
+  void enqueue(Job* job);
+  Job* take(unsigned self);
+  void run(Job* job);
+  void finish(Job* job);
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<Queue>> queues; // one per worker
+  std::atomic<unsigned> nextQueue{0};
+  std::atomic<int> queued{0};
+  std::atomic<unsigned> submitted{0}, finished{0};
+  std::mutex sleepMutex;
+  std::condition_variable sleepCv;
+  bool stopping = false;
+
+  std::chrono::steady_clock::time_point created;
+  mutable std::mutex timingMutex;
+  std::vector<StageTiming> timings;
+};
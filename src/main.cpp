@@ -12,6 +12,24 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "bench.hpp"
+#include "cdlod.hpp"
+#include "clipmap.hpp"
+#include "cubemap_loader.hpp"
+#include "frame_ring.hpp"
+#include "gpu_cull.hpp"
+#include "gpu_profiler.hpp"
+#include "hiz.hpp"
+#include "quadtree.hpp"
+#include "roughness.hpp"
+#include "shader.hpp"
+#include "tess_edges.hpp"
+#include "terrain.hpp"
+#include "terrain_data.hpp"
+#include "virtual_heightmap.hpp"
+
+#include <chrono>
+#include <cmath>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -24,6 +42,7 @@ const unsigned int SCR_HEIGHT = 800;
 const unsigned int NUM_PATCH_PTS = 4;
 int useWireframe = 0;
 int displayGrayscale = 0;
+unsigned requestedRez = 0;
 
 glm::vec3 cameraPos   = glm::vec3(0.0f, 0.0f, 3.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
@@ -40,39 +59,104 @@ bool firstMouse = true;
 
 float fov = 45.0f;
 
-const char* TCS =R"(
-#version 450 core
+int viewportWidth = SCR_WIDTH;
+int viewportHeight = SCR_HEIGHT;
+
+// TERRAIN_HEIGHT_GLSL goes between the #version line and the TCS and TES
+// bodies, followed by TESS_LEVEL_GLSL and QUADTREE_FINER for the TCS
+const char* TCS = R"(
 layout (vertices=4) out;
 
+layout (std430, binding = 3) readonly buffer EdgeLevels { float edgeLevels[]; };
+
 uniform mat4 model;
-uniform mat4 view;
+uniform bool edgeBuffer;      // uniform grid: TessEdgeLevels sized every edge
+uniform float gridRez;
+uniform vec2 terrainSize;
 
 in vec2 TexCoord[];
+in uint Seams[];
 out vec2 TextureCoord[];
+// quadtree sides shared with a different-size node, in outer level order:
+// where the larger node's edge starts along the side, its length (0: not a
+// seam) and its level
+patch out vec4 seamStart;
+patch out vec4 seamSize;
+patch out vec4 seamLevel;
+
+// the level of a quadtree edge that smaller nodes meet, as both sides
+// compute it: odd and whole, so its vertices split it evenly
+float seamEdgeLevel(vec2 a, vec2 b)
+{
+  precise vec3 pa = (model * vec4(terrainSize.x * (a.x - 0.5), terrainHeight(a) * 64.0 - 16.0,
+                                  terrainSize.y * (a.y - 0.5), 1.0)).xyz;
+  precise vec3 pb = (model * vec4(terrainSize.x * (b.x - 0.5), terrainHeight(b) * 64.0 - 16.0,
+                                  terrainSize.y * (b.y - 0.5), 1.0)).xyz;
+  float level = edgeLevel(pa, pb, edgeError(a, b));
+  float maxOdd = 2.0 * floor((maxTessLevel - 1.0) * 0.5) + 1.0;
+  return min(2.0 * ceil((level - 1.0) * 0.5) + 1.0, maxOdd);
+}
 
 void main(){
   gl_out[gl_InvocationID].gl_Position = gl_in[gl_InvocationID].gl_Position;
   TextureCoord[gl_InvocationID] = TexCoord[gl_InvocationID];
 
   if (gl_InvocationID == 0) {
-    const int MIN_TESS_LEVEL = 4;
-    const int MAX_TESS_LEVEL = 64;
-    const float MIN_DISTANCE = 20;
-    const float MAX_DISTANCE = 800;
-    vec4 eyeSpacePos00 = view * model * gl_in[0].gl_Position;
-    vec4 eyeSpacePos01 = view * model * gl_in[1].gl_Position;
-    vec4 eyeSpacePos10 = view * model * gl_in[2].gl_Position;
-    vec4 eyeSpacePos11 = view * model * gl_in[3].gl_Position;
-
-    float distance00 = clamp( (abs(eyeSpacePos00.z) - MIN_DISTANCE) / (MAX_DISTANCE-MIN_DISTANCE), 0.0, 1.0 );
-    float distance01 = clamp( (abs(eyeSpacePos01.z) - MIN_DISTANCE) / (MAX_DISTANCE-MIN_DISTANCE), 0.0, 1.0 );
-    float distance10 = clamp( (abs(eyeSpacePos10.z) - MIN_DISTANCE) / (MAX_DISTANCE-MIN_DISTANCE), 0.0, 1.0 );
-    float distance11 = clamp( (abs(eyeSpacePos11.z) - MIN_DISTANCE) / (MAX_DISTANCE-MIN_DISTANCE), 0.0, 1.0 );
-
-    float tessLevel0 = mix( MAX_TESS_LEVEL, MIN_TESS_LEVEL, min(distance10, distance00) );
-    float tessLevel1 = mix( MAX_TESS_LEVEL, MIN_TESS_LEVEL, min(distance00, distance01) );
-    float tessLevel2 = mix( MAX_TESS_LEVEL, MIN_TESS_LEVEL, min(distance01, distance11) );
-    float tessLevel3 = mix( MAX_TESS_LEVEL, MIN_TESS_LEVEL, min(distance11, distance10) );
+    float tessLevel0, tessLevel1, tessLevel2, tessLevel3;
+    seamStart = seamSize = seamLevel = vec4(0.0);
+    if (edgeBuffer) {
+      // the patch's edges in TessEdgeLevels order: horizontal, then vertical
+      uint rez = uint(gridRez);
+      uvec2 cell = uvec2(round(TexCoord[0] * gridRez));
+      uint vertical = (rez + 1u) * rez + cell.y * (rez + 1u) + cell.x;
+      tessLevel0 = edgeLevels[vertical];
+      tessLevel1 = edgeLevels[cell.y * rez + cell.x];
+      tessLevel2 = edgeLevels[vertical + 1u];
+      tessLevel3 = edgeLevels[(cell.y + 1u) * rez + cell.x];
+    }
+    else {
+      // quadtree nodes share no edge layout; both patches on an edge of
+      // the same size see the same corners, so they agree on it anyway
+      vec3 p[4];
+      for (int i = 0; i < 4; i++) {
+        vec4 corner = gl_in[i].gl_Position;
+        corner.y = terrainHeight(TexCoord[i]) * 64.0 - 16.0;
+        p[i] = (model * corner).xyz;
+      }
+      float levels[4];
+      levels[0] = edgeLevel(p[2], p[0], edgeError(TexCoord[2], TexCoord[0]));
+      levels[1] = edgeLevel(p[0], p[1], edgeError(TexCoord[0], TexCoord[1]));
+      levels[2] = edgeLevel(p[1], p[3], edgeError(TexCoord[1], TexCoord[3]));
+      levels[3] = edgeLevel(p[3], p[2], edgeError(TexCoord[3], TexCoord[2]));
+
+      // Across a seam the TES moves both sides' vertices onto the larger
+      // node's evenly split edge. The larger side tessellates exactly that
+      // edge; the smaller one more finely than it, so every one of those
+      // vertices gets one of its own and the seam closes.
+      float size = TexCoord[3].x - TexCoord[0].x;
+      for (int i = 0; i < 4; i++) {
+        uint seam = (Seams[0] >> (8 * i)) & 0xffu;
+        if (seam == 0u)
+          continue;
+        int along = (i & 1) == 0 ? 1 : 0;
+        vec2 a = TexCoord[i == 2 ? 1 : i == 3 ? 2 : 0];
+        float scale = seam == QUADTREE_FINER ? 1.0 : float(1u << seam);
+        float span = size * scale;
+        float start = floor(a[along] / span) * span;
+        vec2 b = a;
+        a[along] = start;
+        b[along] = start + span;
+        float level = seamEdgeLevel(a, b);
+        levels[i] = seam == QUADTREE_FINER ? level : max(levels[i], level / scale + 1.0);
+        seamStart[i] = start;
+        seamSize[i] = span;
+        seamLevel[i] = level;
+      }
+      tessLevel0 = levels[0];
+      tessLevel1 = levels[1];
+      tessLevel2 = levels[2];
+      tessLevel3 = levels[3];
+    }
 
     gl_TessLevelOuter[0] = tessLevel0;
     gl_TessLevelOuter[1] = tessLevel1;
@@ -86,18 +170,18 @@ void main(){
 )";
 
 const char* TES = R"(
-#version 450 core
 layout(quads, fractional_odd_spacing, ccw) in;
 
-uniform sampler2D heightMap;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform vec2 terrainSize;
 
 in vec2 TextureCoord[];
+patch in vec4 seamStart;
+patch in vec4 seamSize;
+patch in vec4 seamLevel;
 
 out vec3 WorldPos;
-out vec3 WorldNormal;
+out vec2 TexCoord;
 out float Height;
 void main()
 {
@@ -113,39 +197,78 @@ void main()
     vec2 t1 = (t11 - t10) * u + t10;
     vec2 texCoord = (t1 - t0) * v + t0;
 
-    Height = texture(heightMap, texCoord).y * 64.0 - 16.0;
+    // a vertex on a quadtree seam goes to the nearest vertex of the larger
+    // node's edge, computed the same way as on the other side
+    bool onSeam = false;
+    bvec4 side = bvec4(u == 0.0, v == 0.0, u == 1.0, v == 1.0);
+    for (int i = 0; i < 4; i++) {
+      if (side[i] && seamSize[i] > 0.0) {
+        int along = (i & 1) == 0 ? 1 : 0;
+        float j = round((texCoord[along] - seamStart[i]) / seamSize[i] * seamLevel[i]);
+        texCoord[along] = seamStart[i] + j * seamSize[i] / seamLevel[i];
+        onSeam = true;
+      }
+    }
+
+    Height = terrainHeight(texCoord) * 64.0 - 16.0;
 
     vec4 p00 = gl_in[0].gl_Position;
     vec4 p01 = gl_in[1].gl_Position;
     vec4 p10 = gl_in[2].gl_Position;
     vec4 p11 = gl_in[3].gl_Position;
 
+    // displace along the patch plane's normal; shading uses the baked normal map
     vec4 uVec = p01 - p00;
     vec4 vVec = p10 - p00;
     vec4 normal = normalize( vec4(cross(vVec.xyz, uVec.xyz), 0) );
 
     vec4 p0 = (p01 - p00) * u + p00;
     vec4 p1 = (p11 - p10) * u + p10;
-    vec4 p = (p1 - p0) * v + p0 + normal * Height;
+    precise vec4 p = (p1 - p0) * v + p0 + normal * Height;
+    if (onSeam)
+      p = vec4(terrainSize.x * (texCoord.x - 0.5), 0.0, terrainSize.y * (texCoord.y - 0.5), 1.0) + normal * Height;
     
     vec4 worldPos = model * p;
     WorldPos = worldPos.xyz;
-    WorldNormal = normalize(mat3(model) * normal.xyz);
+    TexCoord = texCoord;
 
-    gl_Position = projection * view * worldPos;
+    gl_Position = viewProjection * worldPos;
 }
 )";
 
 const char* VS1 = R"(
 #version 450 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTex;
+layout (location = 0) in uvec2 aGrid;
+layout (location = 1) in vec4 aNode;
+layout (location = 2) in uint aSeams; // quadtree only: TerrainQuadtree::select()
+
+uniform vec2 terrainSize;
+uniform float gridRez;
+uniform int gridMode;
 
 out vec2 TexCoord;
+out uint Seams;
 
 void main(){
-  gl_Position = vec4(aPos, 1.0f);
-  TexCoord = aTex;
+  // patch corners in TES order (0,0) (1,0) (0,1) (1,1)
+  uint corner = uint(gl_VertexID) & 3u;
+  vec2 uv;
+  if (gridMode >= 2) {
+    // quadtree node / GPU-culled patch rectangle, one instance each
+    uv = aNode.xy + vec2(corner & 1u, corner >> 1) * aNode.zw;
+  }
+  else {
+    uvec2 cell = aGrid;
+    if (gridMode == 1) {
+      uint rez = uint(gridRez);
+      uint patchId = uint(gl_VertexID) >> 2;
+      cell = uvec2(patchId % rez, patchId / rez) + uvec2(corner & 1u, corner >> 1);
+    }
+    uv = vec2(cell) / gridRez;
+  }
+  gl_Position = vec4(terrainSize.x * (uv.x - 0.5), 0.0, terrainSize.y * (uv.y - 0.5), 1.0f);
+  TexCoord = uv;
+  Seams = gridMode == 2 ? aSeams : 0u;
 }
 )";
 
@@ -155,9 +278,11 @@ out vec4 FragColor;
 
 in float Height;
 in vec3 WorldPos;
-in vec3 WorldNormal;
+in vec2 TexCoord;
 
 uniform samplerCube skybox;
+uniform sampler2D normalMap;
+uniform mat4 model;
 
 void main()
 {
@@ -167,7 +292,9 @@ void main()
 
     float waterMask = smoothstep(0.15, 0.30, h);
 
-    vec3 N = normalize(WorldNormal);
+    // baked Sobel normal: xz stored, y rebuilt
+    vec2 nxz = texture(normalMap, TexCoord).rg;
+    vec3 N = normalize(mat3(model) * vec3(nxz.x, sqrt(max(1.0 - dot(nxz, nxz), 0.0)), nxz.y));
 
     vec3 down = vec3(0.0, -1.0, 0.0);
 
@@ -183,30 +310,30 @@ void main()
 
 const char* VS2 = R"(
 #version 450 core
-layout (location = 0) in vec3 aPos;
-
-out vec3 TexCoord;
-
-uniform mat4 projection;
-uniform mat4 view;
+out vec4 ViewRay;
 
 void main(){
-  vec4 pos = projection * view * vec4(aPos * 100, 1.0f);
-  gl_Position = pos.xyww;
-  TexCoord = aPos;
+  // one triangle covering the screen, straight from gl_VertexID, on the far
+  // plane so it only lands where the terrain left the cleared depth
+  vec2 ndc = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+  gl_Position = vec4(ndc, 1.0, 1.0);
+  // back through the view-projection without the camera's translation;
+  // homogeneous, so the divide after interpolation keeps it exact
+  ViewRay = inverse(projection * mat4(mat3(view))) * vec4(ndc, 1.0, 1.0);
 }
 )";
 
 const char* FS2 = R"(
 #version 450 core
+layout (early_fragment_tests) in;
 
 out vec4 FragColor;
 
-in vec3 TexCoord;
+in vec4 ViewRay;
 
 uniform samplerCube skybox;
 void main(){
-  FragColor = texture(skybox, TexCoord);
+  FragColor = texture(skybox, ViewRay.xyz / ViewRay.w);
 }
 )";
 
@@ -227,6 +354,17 @@ void processInput(GLFWwindow* window)
         glfwSetWindowShouldClose(window, true);
 }
 
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS || requestedRez == 0)
+        return;
+    // [ and ] halve / double the patch grid resolution
+    if (key == GLFW_KEY_LEFT_BRACKET && requestedRez > 1)
+        requestedRez /= 2;
+    if (key == GLFW_KEY_RIGHT_BRACKET && requestedRez * 2 <= MAX_GRID_REZ)
+        requestedRez *= 2;
+}
+
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
     if (firstMouse) {
@@ -267,45 +405,25 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    viewportWidth = width;
+    viewportHeight = height;
 }
 
-unsigned int loadCubemap(std::vector<std::string> faces)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 
-                         0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap tex failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
-} 
+int main(int argc, char** argv){
+  BenchOptions bench;
+  if (!parseBenchArgs(argc, argv, bench))
+    return -1;
+  ProfilerOptions profile;
+  parseProfilerArgs(argc, argv, profile);
+  TerrainOptions terrain;
+  parseTerrainArgs(argc, argv, terrain);
 
-int main(){
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR,4);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR,5);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  if (bench.enabled)
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
   GLFWwindow* w=glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Graphics Pad", NULL, NULL);
 
@@ -316,125 +434,132 @@ int main(){
   }
   glfwMakeContextCurrent(w);
   glfwSetFramebufferSizeCallback(w, framebuffer_size_callback);
-  glfwSetCursorPosCallback(w, mouse_callback);
-  glfwSetScrollCallback(w, scroll_callback);
-  glfwSetInputMode(w, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+  if (!bench.enabled) {
+    glfwSetCursorPosCallback(w, mouse_callback);
+    glfwSetScrollCallback(w, scroll_callback);
+    glfwSetKeyCallback(w, key_callback);
+    glfwSetInputMode(w, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+  }
 
   if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
     std::cout << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
+
+  // Headless runs render into an offscreen target: a hidden window's default
+  // framebuffer is not guaranteed to be backed by anything.
+  unsigned int benchFBO = 0, benchRBO[2] = {0, 0};
+  if (bench.enabled) {
+    glfwSwapInterval(0);
+    glGenFramebuffers(1, &benchFBO);
+    glGenRenderbuffers(2, benchRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, benchRBO[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT);
+    glBindRenderbuffer(GL_RENDERBUFFER, benchRBO[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT);
+    glBindFramebuffer(GL_FRAMEBUFFER, benchFBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, benchRBO[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, benchRBO[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cout << "Failed to create benchmark framebuffer" << std::endl;
+      return -1;
+    }
+    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+  }
   int maxTessLevel;
   glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &maxTessLevel);
   glEnable(GL_DEPTH_TEST);
   //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-  unsigned int vertexShader1;
-  vertexShader1 = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader1, 1, &VS1, NULL);
-  glCompileShader(vertexShader1);
-
-  unsigned int fragmentShader1;
-  fragmentShader1 = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader1, 1, &FS1, NULL);
-  glCompileShader(fragmentShader1);
-
-  unsigned int vertexShader2;
-  vertexShader2 = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader2, 1, &VS2, NULL);
-  glCompileShader(vertexShader2);
-
-  unsigned int fragmentShader2;
-  fragmentShader2 = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader2, 1, &FS2, NULL);
-  glCompileShader(fragmentShader2);
-  
-  unsigned int tessControlShader;
-  tessControlShader = glCreateShader(GL_TESS_CONTROL_SHADER);
-  glShaderSource(tessControlShader, 1, &TCS, NULL);
-  glCompileShader(tessControlShader);
-  
-  unsigned int tessEvaluationShader;
-  tessEvaluationShader = glCreateShader(GL_TESS_EVALUATION_SHADER);
-  glShaderSource(tessEvaluationShader, 1, &TES, NULL);
-  glCompileShader(tessEvaluationShader);
-  
-  unsigned int shaderProgram1;
-  shaderProgram1 = glCreateProgram();
-  glAttachShader(shaderProgram1, vertexShader1);
-  glAttachShader(shaderProgram1, fragmentShader1);
-  glAttachShader(shaderProgram1, tessControlShader);
-  glAttachShader(shaderProgram1, tessEvaluationShader);
-  glLinkProgram(shaderProgram1);
-  
-  unsigned int shaderProgram2;
-  shaderProgram2 = glCreateProgram();
-  glAttachShader(shaderProgram2, vertexShader2);
-  glAttachShader(shaderProgram2, fragmentShader2);
-  glLinkProgram(shaderProgram2);
+  ShaderProgram shaderProgram1, shaderProgram2, clipmapProgram, cdlodProgram;
+  std::string tcsSource = std::string("#version 450 core\n") + TERRAIN_HEIGHT_GLSL + TESS_LEVEL_GLSL +
+                          "const uint QUADTREE_FINER = " + std::to_string(QUADTREE_FINER) + "u;\n" + TCS;
+  std::string tesSource = std::string("#version 450 core\n") + TERRAIN_HEIGHT_GLSL + TES;
+  std::string cdlodSource = std::string("#version 450 core\n") + TERRAIN_HEIGHT_GLSL + CDLOD_VS;
+  if (!shaderProgram1.link({
+        {GL_VERTEX_SHADER, VS1},
+        {GL_TESS_CONTROL_SHADER, tcsSource.c_str()},
+        {GL_TESS_EVALUATION_SHADER, tesSource.c_str()},
+        {GL_FRAGMENT_SHADER, FS1}}) ||
+      !shaderProgram2.link({
+        {GL_VERTEX_SHADER, VS2},
+        {GL_FRAGMENT_SHADER, FS2}}) ||
+      (terrain.mode == GRID_CLIPMAP && !clipmapProgram.link({
+        {GL_VERTEX_SHADER, CLIPMAP_VS},
+        {GL_FRAGMENT_SHADER, FS1}})) ||
+      (terrain.mode == GRID_CDLOD && !cdlodProgram.link({
+        {GL_VERTEX_SHADER, cdlodSource.c_str()},
+        {GL_FRAGMENT_SHADER, FS1}}))) {
+    glfwTerminate();
+    return -1;
+  }
 
-  glPatchParameteri(GL_PATCH_VERTICES, 4);
-  //stbi_set_flip_vertically_on_load(true);
-  unsigned int texture;
-  glGenTextures(1, &texture);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture); 
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  int width, height, nChannels;
-  unsigned char *data = stbi_load("src/iceland_heightmap.png", &width, &height, &nChannels, 0);
-  if (data)
-  {
-    GLenum format = (nChannels == 4) ? GL_RGBA : GL_RGB;
-    glTexImage2D(GL_TEXTURE_2D, 0, format,
-                 width, height, 0,
-                 format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+  // Samplers and the model matrix never change; everything per-frame goes
+  // through the shared Frame UBO.
+  glm::mat4 model = glm::mat4(1.0f);
+  shaderProgram1.use();
+  glUniform1i(shaderProgram1.uniform("heightMap"), 0);
+  glUniform1i(shaderProgram1.uniform("skybox"), 1);
+  glUniformMatrix4fv(shaderProgram1.uniform("model"), 1, GL_FALSE, glm::value_ptr(model));
+  glUniform1f(shaderProgram1.uniform("maxTessLevel"), (float)maxTessLevel);
+  glUniform1f(shaderProgram1.uniform("edgePixels"), terrain.edgePixels);
+  glUniform1i(shaderProgram1.uniform("roughnessMap"), 3);
+  glUniform1i(shaderProgram1.uniform("normalMap"), 4);
+  glUniform1i(shaderProgram1.uniform("roughnessBlock"), ROUGHNESS_BLOCK);
+  glUniform1f(shaderProgram1.uniform("errorPixels"), terrain.errorPixels);
+  glUniform1i(shaderProgram1.uniform("tileCache"), 5);
+  glUniform1i(shaderProgram1.uniform("tilePages"), 6);
+  shaderProgram2.use();
+  glUniform1i(shaderProgram2.uniform("skybox"), 1);
+  if (terrain.mode == GRID_CLIPMAP) {
+    clipmapProgram.use();
+    glUniform1i(clipmapProgram.uniform("skybox"), 1);
+    glUniform1i(clipmapProgram.uniform("normalMap"), 4);
+    glUniform1i(clipmapProgram.uniform("clipmap"), 7);
+    glUniformMatrix4fv(clipmapProgram.uniform("model"), 1, GL_FALSE, glm::value_ptr(model));
   }
-  else
-  {
-    std::cout << "Failed to load heightmap\n";
+  if (terrain.mode == GRID_CDLOD) {
+    cdlodProgram.use();
+    glUniform1i(cdlodProgram.uniform("heightMap"), 0);
+    glUniform1i(cdlodProgram.uniform("skybox"), 1);
+    glUniform1i(cdlodProgram.uniform("normalMap"), 4);
+    glUniform1i(cdlodProgram.uniform("tileCache"), 5);
+    glUniform1i(cdlodProgram.uniform("tilePages"), 6);
+    glUniformMatrix4fv(cdlodProgram.uniform("model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniform1f(cdlodProgram.uniform("cdlodGrid"), (float)CDLOD_GRID);
+    glUniform1f(cdlodProgram.uniform("lodRange"), CDLOD_LOD_RANGE);
   }
 
-  std::vector<float> vertices;
+  // the Frame UBO and the node lists of the quadtree and CDLOD; grows if a
+  // frame needs more
+  FrameRing ring;
+  if (!ring.init(256 * 1024)) {
+    glfwTerminate();
+    return -1;
+  }
+  FrameUniforms frame;
 
-  unsigned rez = 20;
-  for(unsigned i = 0; i <= rez-1; i++)
-  {
-	  for(unsigned j = 0; j <= rez-1; j++)
-	  {
-		  vertices.push_back(-width/2.0f + width*i/(float)rez); // v.x
-		  vertices.push_back(0.0f); // v.y
-		  vertices.push_back(-height/2.0f + height*j/(float)rez); // v.z
-		  vertices.push_back(i / (float)rez); // u
-		  vertices.push_back(j / (float)rez); // v
-
-		  vertices.push_back(-width/2.0f + width*(i+1)/(float)rez); // v.x
-		  vertices.push_back(0.0f); // v.y
-		  vertices.push_back(-height/2.0f + height*j/(float)rez); // v.z
-		  vertices.push_back((i+1) / (float)rez); // u
-		  vertices.push_back(j / (float)rez); // v
-
-		  vertices.push_back(-width/2.0f + width*i/(float)rez); // v.x
-		  vertices.push_back(0.0f); // v.y
-		  vertices.push_back(-height/2.0f + height*(j+1)/(float)rez); // v.z
-		  vertices.push_back(i / (float)rez); // u
-		  vertices.push_back((j+1) / (float)rez); // v
-
-		  vertices.push_back(-width/2.0f + width*(i+1)/(float)rez); // v.x
-		  vertices.push_back(0.0f); // v.y
-		  vertices.push_back(-height/2.0f + height*(j+1)/(float)rez); // v.z
-		  vertices.push_back((i+1) / (float)rez); // u
-		  vertices.push_back((j+1) / (float)rez); // v
-	  }
+  glPatchParameteri(GL_PATCH_VERTICES, 4);
+  //stbi_set_flip_vertically_on_load(true);
+  // a terrain asset maps everything ready to upload; without one, decode and
+  // every CPU-side bake run as one job graph. GL uploads stay here.
+  JobSystem jobs;
+  TerrainData terrainData;
+  auto startupBegin = std::chrono::steady_clock::now();
+  bool fromAsset = !terrain.assetPath.empty() && openTerrainAsset(terrain.assetPath, terrainData);
+
+  // a virtual heightmap streams its tiles on top of an overview that takes
+  // the heightmap's place, baked from its coarsest tiles unless an asset
+  // has it already
+  VirtualHeightmap virtualHeights;
+  bool virtualMode = !terrain.virtualPath.empty();
+  if (virtualMode && !virtualHeights.open(terrain.virtualPath, terrain.tileCache)) {
+    glfwTerminate();
+    return -1;
   }
-  stbi_image_free(data);
-  std::cout << "Loaded " << rez*rez << " patches of 4 control points each" << std::endl;
-  std::cout << "Processing " << rez*rez*4 << " vertices in vertex shader" << std::endl;
 
-  
+  // the sky decodes alongside the terrain bake and streams in once ready,
+  // the clear colour standing in until then
   std::vector<std::string> faces =
   {
     "skybox/right.jpg",
@@ -444,76 +569,206 @@ int main(){
     "skybox/front.jpg",
     "skybox/back.jpg"
   };
-  unsigned int cubemapTexture = loadCubemap(faces);  
-  std::vector<float> skyboxVertices = {
-    // positions          
-    -1.0f,  1.0f, -1.0f,
-    -1.0f, -1.0f, -1.0f,
-     1.0f, -1.0f, -1.0f,
-     1.0f, -1.0f, -1.0f,
-     1.0f,  1.0f, -1.0f,
-    -1.0f,  1.0f, -1.0f,
-
-    -1.0f, -1.0f,  1.0f,
-    -1.0f, -1.0f, -1.0f,
-    -1.0f,  1.0f, -1.0f,
-    -1.0f,  1.0f, -1.0f,
-    -1.0f,  1.0f,  1.0f,
-    -1.0f, -1.0f,  1.0f,
-
-     1.0f, -1.0f, -1.0f,
-     1.0f, -1.0f,  1.0f,
-     1.0f,  1.0f,  1.0f,
-     1.0f,  1.0f,  1.0f,
-     1.0f,  1.0f, -1.0f,
-     1.0f, -1.0f, -1.0f,
-
-    -1.0f, -1.0f,  1.0f,
-    -1.0f,  1.0f,  1.0f,
-     1.0f,  1.0f,  1.0f,
-     1.0f,  1.0f,  1.0f,
-     1.0f, -1.0f,  1.0f,
-    -1.0f, -1.0f,  1.0f,
-
-    -1.0f,  1.0f, -1.0f,
-     1.0f,  1.0f, -1.0f,
-     1.0f,  1.0f,  1.0f,
-     1.0f,  1.0f,  1.0f,
-    -1.0f,  1.0f,  1.0f,
-    -1.0f,  1.0f, -1.0f,
-
-    -1.0f, -1.0f, -1.0f,
-    -1.0f, -1.0f,  1.0f,
-     1.0f, -1.0f, -1.0f,
-     1.0f, -1.0f, -1.0f,
-    -1.0f, -1.0f,  1.0f,
-     1.0f, -1.0f,  1.0f
-  };
-  unsigned int VBO[2], VAO[2];
-  glGenBuffers(2, VBO);
-  glGenVertexArrays(2, VAO);
-  glBindVertexArray(VAO[0]);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),(void*) (3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-
-  glBindVertexArray(VAO[1]);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
-  glBufferData(GL_ARRAY_BUFFER, skyboxVertices.size() * sizeof(float), &skyboxVertices[0], GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
+  const unsigned char skyColor[3] = { 179, 207, 255 };
+  CubemapLoader sky;
+  if (fromAsset && terrainData.images[SECTION_SKYBOX].data)
+    sky.load(terrainData.images[SECTION_SKYBOX]);
+  else
+    sky.start(faces, jobs, skyColor, terrain.compressSky);
+  glActiveTexture(GL_TEXTURE0);
+  bool loaded = fromAsset;
+  if (!loaded && virtualMode) {
+    std::vector<unsigned short> overview;
+    int overviewWidth, overviewHeight;
+    virtualHeights.overview(overview, overviewWidth, overviewHeight);
+    loaded = bakeTerrainData(std::move(overview), overviewWidth, overviewHeight, 16, jobs, terrainData);
+  }
+  else if (!loaded) {
+    loaded = bakeTerrainData(terrain.heightmapPath.c_str(), jobs, terrainData);
+  }
+  if (loaded && virtualMode && (terrainData.width != std::max(1, virtualHeights.width() >> virtualHeights.levels()) ||
+                                terrainData.height != std::max(1, virtualHeights.height() >> virtualHeights.levels()))) {
+    std::cout << "Terrain asset " << terrain.assetPath << " is not the overview of " << terrain.virtualPath << std::endl;
+    sky.destroy();
+    virtualHeights.destroy(jobs);
+    glfwTerminate();
+    return -1;
+  }
+  // world units are level-0 texels, so a virtual heightmap sets the size
+  int width = virtualMode ? virtualHeights.width() : terrainData.width;
+  int height = virtualMode ? virtualHeights.height() : terrainData.height;
+  unsigned int heightTexture = 0;
+  if (loaded)
+  {
+    // one 16-bit channel: all the TES reads, and no terracing from 16-bit sources
+    heightTexture = uploadTexture(terrainData.images[SECTION_HEIGHTS].layout, terrainData.images[SECTION_HEIGHTS].data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    std::cout << (virtualMode ? "Overview " : "Heightmap ") << terrainData.width << "x" << terrainData.height
+              << ", " << terrainData.sourceBits << "-bit source\n";
+    if (fromAsset)
+      std::cout << "Mapped terrain asset " << terrain.assetPath << "\n";
+    else
+      std::cout << "Startup jobs (" << jobs.threadCount() << " workers + main thread):\n" << jobs.stageReport();
+  }
+  if (loaded && !fromAsset && !terrain.assetPath.empty() && writeTerrainAsset(terrain.assetPath, terrainData))
+    std::cout << "Wrote terrain asset " << terrain.assetPath << "\n";
+
+  // geometric error for the TCS, on texture unit 3
+  unsigned int roughnessTexture = 0;
+  if (loaded) {
+    glActiveTexture(GL_TEXTURE3);
+    roughnessTexture = uploadTexture(terrainData.images[SECTION_ROUGHNESS].layout,
+                                     terrainData.images[SECTION_ROUGHNESS].data, false);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // shading normals for FS1, on texture unit 4
+  unsigned int normalTexture = 0;
+  if (loaded) {
+    glActiveTexture(GL_TEXTURE4);
+    normalTexture = uploadTexture(terrainData.images[SECTION_NORMALS].layout,
+                                  terrainData.images[SECTION_NORMALS].data);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // min/max bounds for culling; the GPU copy lives on texture unit 2
+  unsigned int heightPyramidTexture = 0;
+  if (terrain.mode == GRID_GPU && loaded) {
+    glActiveTexture(GL_TEXTURE2);
+    heightPyramidTexture = uploadTexture(terrainData.images[SECTION_PYRAMID].layout,
+                                         terrainData.images[SECTION_PYRAMID].data, false);
+    glActiveTexture(GL_TEXTURE0);
+  }
+  // clipmap heights for CLIPMAP_VS, on texture unit 7; a virtual heightmap
+  // supplies its finer levels straight from the tiles
+  TerrainClipmap clipmap;
+  if (terrain.mode == GRID_CLIPMAP && loaded) {
+    clipmap.init(terrainData.images[SECTION_HEIGHTS], virtualMode ? &virtualHeights : nullptr, width, height,
+                 terrain.clipmapGrid);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, clipmap.heightTexture());
+    glActiveTexture(GL_TEXTURE0);
+  }
+  releaseTerrainImages(terrainData);
+  if (loaded)
+    std::cout << "Terrain ready after "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count()
+              << " ms\n";
+
+  // CDLOD walks the same quadtree, with ranges its morph can cover
+  TerrainQuadtree quadtree;
+  std::vector<glm::vec4> quadtreeNodes;
+  std::vector<unsigned> quadtreeSeams;
+  if (terrain.mode == GRID_CDLOD)
+    quadtree.lodRange = CDLOD_LOD_RANGE;
+  if ((terrain.mode == GRID_QUADTREE || terrain.mode == GRID_CDLOD) && loaded)
+    quadtree.build(terrainData.pyramid, terrain.rez, glm::vec2(width, height));
+  CdlodGrid cdlod;
+  if (terrain.mode == GRID_CDLOD)
+    cdlod.init();
+
+  PatchGrid grid;
+  if (terrain.mode != GRID_CLIPMAP && terrain.mode != GRID_CDLOD)
+    grid = createPatchGrid(terrain.mode == GRID_QUADTREE ? quadtree.leafCount() : terrain.rez, terrain.mode);
+  // the quadtree and GPU culler are built for a fixed size, so [ ] only
+  // drive the plain grids
+  requestedRez = terrain.mode == GRID_INDEXED || terrain.mode == GRID_PROCEDURAL ? grid.rez : 0;
+  GpuPatchCuller culler;
+  if (grid.mode == GRID_GPU && !culler.init(heightPyramidTexture, grid, width, height)) {
+    sky.destroy();
+    if (virtualMode)
+      virtualHeights.destroy(jobs);
+    glfwTerminate();
+    return -1;
+  }
+  // last frame's depth hides patches behind ridges from the culler
+  HiZBuffer hiz;
+  glm::mat4 hizViewProjection(1.0f);
+  bool occlusion = terrain.occlusionCull && grid.mode == GRID_GPU;
+  if (terrain.occlusionCull && !occlusion)
+    std::cout << "Ignoring --occlusion-cull (needs --grid gpu)" << std::endl;
+  if (occlusion && !hiz.init(viewportWidth, viewportHeight)) {
+    sky.destroy();
+    if (virtualMode)
+      virtualHeights.destroy(jobs);
+    glfwTerminate();
+    return -1;
+  }
+  // every uniform grid shares its edges' levels through one buffer
+  bool edgeBuffer = terrain.mode == GRID_INDEXED || terrain.mode == GRID_PROCEDURAL || terrain.mode == GRID_GPU;
+  TessEdgeLevels edgeLevels;
+  if (edgeBuffer && !edgeLevels.init(width, height, terrain, (float)maxTessLevel, virtualMode ? &virtualHeights : nullptr)) {
+    sky.destroy();
+    if (virtualMode)
+      virtualHeights.destroy(jobs);
+    glfwTerminate();
+    return -1;
+  }
+  shaderProgram1.use();
+  glUniform2f(shaderProgram1.uniform("terrainSize"), (float)width, (float)height);
+  glUniform1f(shaderProgram1.uniform("gridRez"), (float)grid.rez);
+  glUniform1i(shaderProgram1.uniform("gridMode"), grid.mode);
+  glUniform1i(shaderProgram1.uniform("edgeBuffer"), edgeBuffer);
+  glUniform1i(shaderProgram1.uniform("virtualHeights"), virtualMode);
+  if (virtualMode) {
+    glUniform2i(shaderProgram1.uniform("virtualSize"), width, height);
+    glUniform1i(shaderProgram1.uniform("tileTexels"), VIRTUAL_TILE);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, virtualHeights.cacheTexture());
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, virtualHeights.pageTexture());
+    glActiveTexture(GL_TEXTURE0);
+  }
+  if (terrain.mode == GRID_CLIPMAP) {
+    clipmapProgram.use();
+    glUniform2f(clipmapProgram.uniform("terrainSize"), (float)width, (float)height);
+  }
+  if (terrain.mode == GRID_CDLOD) {
+    cdlodProgram.use();
+    glUniform2f(cdlodProgram.uniform("terrainSize"), (float)width, (float)height);
+    glUniform1i(cdlodProgram.uniform("virtualHeights"), virtualMode);
+    glUniform2i(cdlodProgram.uniform("virtualSize"), width, height);
+    glUniform1i(cdlodProgram.uniform("tileTexels"), VIRTUAL_TILE);
+  }
+
+
+  // the skybox triangle has no vertex data, but a draw needs a VAO bound
+  unsigned int skyboxVAO;
+  glGenVertexArrays(1, &skyboxVAO);
 
   glPatchParameteri(GL_PATCH_VERTICES, NUM_PATCH_PTS);
-  
+
+  // benchmarks measure the finished scene
+  if (bench.enabled)
+    sky.finish();
+
+  bool profiling = bench.enabled || profile.enabled;
+  GpuProfiler profiler;
+  profiler.init(bench.enabled || !profile.outPath.empty(), bench.enabled ? bench.warmup : 1);
+  std::vector<BenchFrame> benchFrames;
+  if (bench.enabled)
+    benchFrames.reserve(bench.frames);
+  unsigned frameIndex = 0;
+  auto benchPrevStart = std::chrono::steady_clock::now();
+  double lastSummary = glfwGetTime();
+
   while(!glfwWindowShouldClose(w)){
+    if (bench.enabled && frameIndex == bench.warmup + bench.frames)
+      break;
+    unsigned benchFrame = frameIndex < bench.warmup ? 0 : frameIndex - bench.warmup;
+    auto frameStart = std::chrono::steady_clock::now();
+
     float currentFrame = glfwGetTime();
     deltaTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
     
-    processInput(w);
+    if (bench.enabled)
+      benchCameraAt(benchFrame, bench.frames, (float)width, (float)height, cameraPos, cameraFront);
+    else
+      processInput(w);
+    if (profiling)
+      profiler.beginFrame(frameIndex);
     
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
     glClearColor(0.70, 0.81, 1.0, 1);
@@ -521,67 +776,184 @@ int main(){
     glDepthFunc(GL_LESS);
     glDepthMask(GL_TRUE);
 
-    glUseProgram(shaderProgram1);
-    
-    glm::mat4 view = glm::mat4(1.0f);
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 5000.0f);
-    view = glm::lookAt(
+    glm::mat4 projection = glm::perspective(glm::radians(fov), (float)viewportWidth / (float)viewportHeight, 0.1f, 5000.0f);
+    glm::mat4 view = glm::lookAt(
       cameraPos,
       cameraPos + cameraFront,
       cameraUp
     );
-    glm::mat4 model = glm::mat4(1.0f);
-    
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewProjection = projection * view;
+    frame.cameraPos = glm::vec4(cameraPos, 1.0f);
+    frame.viewport = glm::vec4(viewportWidth, viewportHeight, std::tan(glm::radians(fov) * 0.5f), currentFrame);
+    ring.beginFrame();
+    // first in its section, which always has room for it
+    size_t frameOffset;
+    if (ring.write(&frame, sizeof(frame), frameOffset))
+      glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, ring.buffer(), frameOffset, sizeof(frame));
+
+    sky.update();
+    // benchmarks render every frame with all the tiles it needs; the
+    // clipmap reads its tiles on the CPU instead
+    if (virtualMode && terrain.mode != GRID_CLIPMAP)
+      virtualHeights.update(cameraPos, jobs, bench.enabled);
+    if (terrain.mode == GRID_CLIPMAP)
+      clipmap.update(cameraPos);
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-    glUniform1i(glGetUniformLocation(shaderProgram1, "skybox"), 1);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, sky.texture());
 
-    glUniform3fv(
-      glGetUniformLocation(shaderProgram1, "cameraPos"),
-      1,
-      glm::value_ptr(cameraPos)
-    );
+    if (grid.mode == GRID_QUADTREE) {
+      quadtreeNodes.clear();
+      quadtreeSeams.clear();
+      quadtree.select(frame.viewProjection, cameraPos, quadtreeNodes, quadtreeSeams);
+      setPatchGridNodes(grid, quadtreeNodes, quadtreeSeams, ring);
+    }
+    else if (terrain.mode == GRID_CDLOD) {
+      quadtreeNodes.clear();
+      quadtree.selectGround(frame.viewProjection, cameraPos, quadtreeNodes);
+      cdlod.setNodes(quadtreeNodes, ring);
+    }
+    else if (grid.mode == GRID_GPU) {
+      if (profiling)
+        profiler.beginPass("cull");
+      culler.cull(grid, occlusion ? &hiz : nullptr, hizViewProjection);
+      if (profiling)
+        profiler.endPass();
+    }
 
-    glUniform1i(glGetUniformLocation(shaderProgram1, "heightMap"), 0);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram1, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram1, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram1, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    shaderProgram1.use();
+    if (requestedRez != 0 && requestedRez != grid.rez) {
+      resizePatchGrid(grid, requestedRez);
+      glUniform1f(shaderProgram1.uniform("gridRez"), (float)grid.rez);
+    }
+    if (edgeBuffer) {
+      if (profiling)
+        profiler.beginPass("edges");
+      edgeLevels.compute(grid);
+      shaderProgram1.use();
+      if (profiling)
+        profiler.endPass();
+    }
 
-    glBindVertexArray(VAO[0]);
-    glDrawArrays(GL_PATCHES, 0, NUM_PATCH_PTS * rez * rez);
+    if (profiling)
+      profiler.beginPass("terrain");
+    if (terrain.mode == GRID_CLIPMAP) {
+      clipmapProgram.use();
+      clipmap.draw(clipmapProgram);
+    }
+    else if (terrain.mode == GRID_CDLOD) {
+      cdlodProgram.use();
+      glUniform1f(cdlodProgram.uniform("groundAltitude"), quadtree.groundAltitude(cameraPos));
+      cdlod.draw();
+    }
+    else {
+      drawPatchGrid(grid);
+    }
+    if (profiling)
+      profiler.endPass();
+
+    if (occlusion) {
+      if (profiling)
+        profiler.beginPass("hiz");
+      hiz.resize(viewportWidth, viewportHeight);
+      hiz.build();
+      hizViewProjection = frame.viewProjection;
+      if (profiling)
+        profiler.endPass();
+    }
 
     glDepthFunc(GL_LEQUAL);
     glDepthMask(GL_FALSE);
 
-    glUseProgram(shaderProgram2);
+    shaderProgram2.use();
 
-    glm::mat4 skyboxView = glm::mat4(glm::mat3(view));
-
-    glUniformMatrix4fv(
-    glGetUniformLocation(shaderProgram2, "view"),
-    1, GL_FALSE, glm::value_ptr(skyboxView)
-    );
-    glUniformMatrix4fv(
-    glGetUniformLocation(shaderProgram2, "projection"),
-    1, GL_FALSE, glm::value_ptr(projection)
-    );
-    glUniform1i(glGetUniformLocation(shaderProgram2, "skybox"), 0);
-
-    glBindVertexArray(VAO[1]);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    if (profiling)
+      profiler.beginPass("skybox");
+    glBindVertexArray(skyboxVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    if (profiling)
+      profiler.endPass();
+    ring.endFrame();
 
     glDepthMask(GL_TRUE);
     glDepthFunc(GL_LESS);
 
-    glfwSwapBuffers(w);
+    if (profiling)
+      profiler.endFrame();
+
+    if (bench.enabled && frameIndex >= bench.warmup) {
+      auto submitted = std::chrono::steady_clock::now();
+      BenchFrame f = {};
+      f.frame = benchFrame;
+      f.cpuMs = std::chrono::duration<double, std::milli>(submitted - frameStart).count();
+      f.frameMs = std::chrono::duration<double, std::milli>(frameStart - benchPrevStart).count();
+      benchFrames.push_back(f);
+    }
+    if (bench.enabled)
+      benchPrevStart = frameStart;
+    else
+      glfwSwapBuffers(w);
+
+    if (profile.enabled && currentFrame - lastSummary >= 1.0) {
+      std::string line = profiler.summary();
+      std::cout << line << std::endl;
+      if (!bench.enabled)
+        glfwSetWindowTitle(w, ("Graphics Pad | " + line).c_str());
+      lastSummary = currentFrame;
+    }
     glfwPollEvents();
+    frameIndex++;
+  }
+
+  profiler.flush();
+  if (!profile.outPath.empty())
+    profiler.dump(profile.outPath);
+  profiler.destroy();
+
+  if (bench.enabled) {
+    for (const GpuFrameSample& s : profiler.history()) {
+      if (s.frame < bench.warmup || s.frame - bench.warmup >= benchFrames.size())
+        continue;
+      BenchFrame& f = benchFrames[s.frame - bench.warmup];
+      for (const GpuPassSample& pass : s.passes) {
+        f.gpuMs += pass.ms;
+        f.primitives += pass.primitives;
+      }
+    }
+    writeBenchResults(bench.outPath, benchFrames);
+    glDeleteRenderbuffers(2, benchRBO);
+    glDeleteFramebuffers(1, &benchFBO);
+  }
+  if (grid.mode == GRID_GPU)
+    culler.destroy();
+  if (edgeBuffer)
+    edgeLevels.destroy();
+  if (occlusion)
+    hiz.destroy();
+  glDeleteTextures(1, &heightTexture);
+  glDeleteTextures(1, &heightPyramidTexture);
+  glDeleteTextures(1, &roughnessTexture);
+  glDeleteTextures(1, &normalTexture);
+  sky.destroy();
+  cdlod.destroy();
+  if (terrain.mode == GRID_CLIPMAP) {
+    std::cout << "Clipmap: " << clipmap.uploadedTexels() << " height texels uploaded over " << frameIndex
+              << " frames" << std::endl;
+    clipmap.destroy();
+  }
+  if (virtualMode) {
+    std::cout << "Virtual heightmap: " << virtualHeights.streamedTiles() << " tiles streamed, "
+              << virtualHeights.residentTiles() << " resident at exit" << std::endl;
+    virtualHeights.destroy(jobs);
   }
-  glDeleteVertexArrays(2, VAO);
-  glDeleteBuffers(2, VBO);
-  glDeleteProgram(shaderProgram1);
-  glDeleteProgram(shaderProgram2);
+  destroyPatchGrid(grid);
+  glDeleteVertexArrays(1, &skyboxVAO);
+  ring.destroy();
+  shaderProgram1.destroy();
+  shaderProgram2.destroy();
+  clipmapProgram.destroy();
+  cdlodProgram.destroy();
 
   glfwTerminate();
   return 0;
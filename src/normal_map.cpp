@@ -0,0 +1,51 @@
+#include "normal_map.hpp"
+
+#include "height_kernels.hpp"
+#include "height_pyramid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+void bakeNormalRows(const unsigned short* heights, int width, int height,
+                    int y0, int y1, signed char* normals)
+{
+    const float scale = HEIGHT_SCALE / 65535.0f;
+
+    // three rows of world heights, padded with a clamped texel either side
+    size_t stride = (size_t)width + 2;
+    std::vector<float> rows(stride * 3);
+    auto loadRow = [&](int y, float* row) {
+        y = std::clamp(y, 0, height - 1);
+        convertHeightsFloat(heights + (size_t)y * width, width, scale, 0.0f, row + 1);
+        row[0] = row[1];
+        row[width + 1] = row[width];
+    };
+    float* above = &rows[0];
+    float* row = &rows[stride];
+    float* below = &rows[2 * stride];
+    loadRow(y0 - 1, above);
+    loadRow(y0, row);
+    loadRow(y0 + 1, below);
+
+    for (int y = y0; y < y1; y++) {
+        sobelNormalRow(above, row, below, width, &normals[(size_t)y * width * 2]);
+        std::swap(above, row);
+        std::swap(row, below);
+        loadRow(y + 2, below);
+    }
+}
+
+void downsampleNormals(const signed char* src, int width, int height, signed char* dst)
+{
+    int w = std::max(1, width / 2), h = std::max(1, height / 2);
+    for (int y = 0; y < h; y++) {
+        const signed char* row0 = src + (size_t)std::min(2 * y, height - 1) * width * 2;
+        const signed char* row1 = src + (size_t)std::min(2 * y + 1, height - 1) * width * 2;
+        if (width > 1)
+            boxFilterPairs2x2(row0, row1, w, dst + (size_t)y * w * 2);
+        else
+            for (int c = 0; c < 2; c++)
+                dst[(size_t)y * 2 + c] = (signed char)std::lround((row0[c] + row1[c]) / 2.0f);
+    }
+}
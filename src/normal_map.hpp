@@ -0,0 +1,17 @@
+#pragma once
+
+// Terrain normals baked from the heightmap with a Sobel kernel: snorm8
+// pairs holding the world-space normal's x and z; y is always up, so
+// shaders rebuild it as sqrt(1 - x^2 - z^2). One heightmap texel is one
+// world unit, as in VS1. TerrainData compresses the map and its mips to
+// BC5 for the texture FS1 samples.
+//
+// `heights` are 16-bit normalized, as uploaded for the TES. bakeNormalRows()
+// fills rows [y0, y1) of `normals` (two bytes per texel, whole map) and
+// reads height rows y0 - 1 to y1.
+void bakeNormalRows(const unsigned short* heights, int width, int height,
+                    int y0, int y1, signed char* normals);
+
+// Next mip level: 2x2 box filter of x and z into max(1, width / 2) x
+// max(1, height / 2) texels, like glGenerateMipmap.
+void downsampleNormals(const signed char* src, int width, int height, signed char* dst);
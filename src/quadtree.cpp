@@ -0,0 +1,140 @@
+#include "quadtree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+
+unsigned TerrainQuadtree::nodeIndex(unsigned level, unsigned x, unsigned z) const
+{
+    return levelOffset[level] + z * (1u << level) + x;
+}
+
+void TerrainQuadtree::build(const HeightPyramid& heights, unsigned rez, glm::vec2 worldSize)
+{
+    width = worldSize.x;
+    height = worldSize.y;
+    depth = 0;
+    while ((1u << depth) < rez)
+        depth++;
+
+    levelOffset.assign(depth + 1, 0);
+    unsigned total = 0;
+    for (unsigned l = 0; l <= depth; l++) {
+        levelOffset[l] = total;
+        total += (1u << l) * (1u << l);
+    }
+    minHeight.assign(total, 0.0f);
+    maxHeight.assign(total, 0.0f);
+
+    // leaves from the pyramid, inner nodes from their children, which is
+    // tighter than querying the pyramid for the larger rectangle
+    unsigned leaves = 1u << depth;
+    float size = 1.0f / leaves;
+    for (unsigned z = 0; z < leaves; z++) {
+        for (unsigned x = 0; x < leaves; x++) {
+            glm::vec2 uv0(x * size, z * size);
+            glm::vec2 bounds = heights.boundsUV(uv0, uv0 + size);
+            unsigned i = nodeIndex(depth, x, z);
+            minHeight[i] = bounds.x;
+            maxHeight[i] = bounds.y;
+        }
+    }
+
+    for (unsigned l = depth; l-- > 0;) {
+        unsigned n = 1u << l;
+        for (unsigned z = 0; z < n; z++) {
+            for (unsigned x = 0; x < n; x++) {
+                unsigned i = nodeIndex(l, x, z);
+                minHeight[i] = maxHeight[i] = 0.0f;
+                for (unsigned c = 0; c < 4; c++) {
+                    unsigned child = nodeIndex(l + 1, 2 * x + (c & 1), 2 * z + (c >> 1));
+                    minHeight[i] = c ? std::min(minHeight[i], minHeight[child]) : minHeight[child];
+                    maxHeight[i] = c ? std::max(maxHeight[i], maxHeight[child]) : maxHeight[child];
+                }
+            }
+        }
+    }
+    std::cout << "Built terrain quadtree: " << depth + 1 << " levels, " << total << " nodes" << std::endl;
+}
+
+void TerrainQuadtree::selectNode(const Frustum& frustum, const glm::vec3& cameraPos, float altitude,
+                                 unsigned level, unsigned x, unsigned z,
+                                 std::vector<glm::vec4>& patches, std::unordered_map<unsigned, bool>* visited) const
+{
+    float scale = 1.0f / (1u << level);
+    glm::vec2 uv0(x * scale, z * scale);
+    glm::vec3 lo(width * (uv0.x - 0.5f), minHeight[nodeIndex(level, x, z)], height * (uv0.y - 0.5f));
+    glm::vec3 hi(lo.x + width * scale, maxHeight[nodeIndex(level, x, z)], lo.z + height * scale);
+
+    if (!boxInFrustum(frustum, lo, hi))
+        return;
+
+    if (level < depth) {
+        glm::vec3 nearest = glm::clamp(cameraPos, lo, hi);
+        if (altitude >= 0.0f)
+            nearest.y = cameraPos.y - altitude;
+        float extent = std::max(hi.x - lo.x, hi.z - lo.z);
+        if (glm::length(cameraPos - nearest) < lodRange * extent) {
+            if (visited)
+                (*visited)[nodeIndex(level, x, z)] = false;
+            for (unsigned c = 0; c < 4; c++)
+                selectNode(frustum, cameraPos, altitude, level + 1, 2 * x + (c & 1), 2 * z + (c >> 1), patches,
+                           visited);
+            return;
+        }
+    }
+    if (visited)
+        (*visited)[nodeIndex(level, x, z)] = true;
+    patches.push_back(glm::vec4(uv0.x, uv0.y, scale, scale));
+}
+
+unsigned TerrainQuadtree::seam(const std::unordered_map<unsigned, bool>& visited, unsigned level, int x, int z) const
+{
+    int n = 1 << level;
+    if (x < 0 || z < 0 || x >= n || z >= n)
+        return 0;
+    auto it = visited.find(nodeIndex(level, x, z));
+    if (it != visited.end())
+        return it->second ? 0 : QUADTREE_FINER;
+    // the first selected ancestor covers the cell
+    for (unsigned up = 1; up <= level; up++) {
+        it = visited.find(nodeIndex(level - up, x >> up, z >> up));
+        if (it != visited.end())
+            return it->second ? up : 0;
+    }
+    return 0;
+}
+
+void TerrainQuadtree::select(const glm::mat4& viewProjection, const glm::vec3& cameraPos,
+                             std::vector<glm::vec4>& patches, std::vector<unsigned>& seams) const
+{
+    if (minHeight.empty())
+        return;
+    size_t first = patches.size();
+    std::unordered_map<unsigned, bool> visited;
+    selectNode(extractFrustum(viewProjection), cameraPos, -1.0f, 0, 0, 0, patches, &visited);
+
+    // node sizes are powers of two, so level and position come back exactly
+    for (size_t i = first; i < patches.size(); i++) {
+        unsigned level = 0;
+        while ((1.0f / (1u << level)) > patches[i].z)
+            level++;
+        int x = (int)(patches[i].x * (1u << level)), z = (int)(patches[i].y * (1u << level));
+        seams.push_back(seam(visited, level, x - 1, z) | seam(visited, level, x, z - 1) << 8 |
+                        seam(visited, level, x + 1, z) << 16 | seam(visited, level, x, z + 1) << 24);
+    }
+}
+
+void TerrainQuadtree::selectGround(const glm::mat4& viewProjection, const glm::vec3& cameraPos,
+                                   std::vector<glm::vec4>& patches) const
+{
+    if (minHeight.empty())
+        return;
+    selectNode(extractFrustum(viewProjection), cameraPos, groundAltitude(cameraPos), 0, 0, 0, patches, nullptr);
+}
+
+float TerrainQuadtree::groundAltitude(const glm::vec3& cameraPos) const
+{
+    return maxHeight.empty() ? 0.0f : std::max(cameraPos.y - maxHeight[0], 0.0f);
+}
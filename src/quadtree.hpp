@@ -0,0 +1,63 @@
+#pragma once
+
+#include "frustum.hpp"
+#include "height_pyramid.hpp"
+
+#include <glm/glm.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+// Seam byte of TerrainQuadtree::select(): smaller nodes across the side.
+const unsigned QUADTREE_FINER = 0x80;
+
+// Full quadtree over the heightmap with per-node min/max height. Each frame
+// select() walks it against the view frustum and emits one patch per
+// visible node, subdividing while the camera is close relative to the node
+// size. Level `depth` nodes are the finest and match a --rez grid.
+class TerrainQuadtree {
+public:
+  // Node bounds come from `heights`; `rez` is the finest patch count per
+  // side and `worldSize` the map's world extent (its texels, unless `heights` is
+  // a virtual heightmap's overview).
+  void build(const HeightPyramid& heights, unsigned rez, glm::vec2 worldSize);
+
+  // Appends (u0, v0, du, dv) in texture space for every selected node, and
+  // to `seams` what lies across each of its sides: a byte per side in the
+  // TCS's outer level order (u = u0, v = v0, u = u0 + du, v = v0 + dv)
+  // holding how many levels coarser the node there is, or QUADTREE_FINER
+  // if smaller nodes were selected there. 0 for a same-size or culled
+  // neighbour.
+  void select(const glm::mat4& viewProjection, const glm::vec3& cameraPos,
+              std::vector<glm::vec4>& patches, std::vector<unsigned>& seams) const;
+  // The same walk for CDLOD (see cdlod.hpp), measuring distances in the
+  // ground plane plus groundAltitude() as a constant height, so a node's
+  // distance bounds those of its vertices.
+  void selectGround(const glm::mat4& viewProjection, const glm::vec3& cameraPos,
+                    std::vector<glm::vec4>& patches) const;
+  // The camera's height above the tallest node, 0 below it.
+  float groundAltitude(const glm::vec3& cameraPos) const;
+
+  unsigned nodeCount() const { return (unsigned)minHeight.size(); }
+  // finest nodes per side: rez rounded up to a power of two
+  unsigned leafCount() const { return 1u << depth; }
+
+  // A node is split while the camera is closer than lodRange node extents.
+  float lodRange = 2.0f;
+
+private:
+  unsigned nodeIndex(unsigned level, unsigned x, unsigned z) const;
+  // `altitude` < 0 measures distances to the node's box, otherwise in the
+  // ground plane with that height on top
+  // `visited`, if given, gets every node that passed the frustum: true if
+  // it was selected, false if it was split
+  void selectNode(const Frustum& frustum, const glm::vec3& cameraPos, float altitude,
+                  unsigned level, unsigned x, unsigned z,
+                  std::vector<glm::vec4>& patches, std::unordered_map<unsigned, bool>* visited) const;
+  unsigned seam(const std::unordered_map<unsigned, bool>& visited, unsigned level, int x, int z) const;
+
+  unsigned depth = 0;
+  float width = 0.0f, height = 0.0f;
+  std::vector<unsigned> levelOffset;
+  std::vector<float> minHeight, maxHeight;
+};
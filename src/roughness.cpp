@@ -0,0 +1,105 @@
+#include "roughness.hpp"
+
+#include "height_pyramid.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Max deviation from the bilinear patch through the corners of texels
+// [x0, x1] x [y0, y1], in heightmap units.
+static float blockError(const unsigned short* heights, int width, int x0, int y0, int x1, int y1)
+{
+    auto at = [&](int x, int y) { return (float)heights[(size_t)y * width + x]; };
+    float h00 = at(x0, y0), h10 = at(x1, y0), h01 = at(x0, y1), h11 = at(x1, y1);
+    float sx = x1 > x0 ? 1.0f / (x1 - x0) : 0.0f;
+    float sy = y1 > y0 ? 1.0f / (y1 - y0) : 0.0f;
+
+    float error = 0.0f;
+    for (int y = y0; y <= y1; y++) {
+        float v = (y - y0) * sy;
+        float a = h00 + (h01 - h00) * v;
+        float b = h10 + (h11 - h10) * v;
+        for (int x = x0; x <= x1; x++) {
+            float u = (x - x0) * sx;
+            error = std::max(error, std::fabs(at(x, y) - (a + (b - a) * u)));
+        }
+    }
+    return error;
+}
+
+void RoughnessMap::build(const unsigned short* heights, int width, int height)
+{
+    allocate(width, height);
+    for (unsigned l = 0; l < levels.size(); l++)
+        buildRows(l, heights, 0, levels[l].height);
+    std::cout << "Built roughness map: " << levels[0].width << "x" << levels[0].height << ", "
+              << levels.size() << " levels" << std::endl;
+}
+
+void RoughnessMap::allocate(int width, int height)
+{
+    mapWidth = width;
+    mapHeight = height;
+    int baseWidth = std::max(1, width / ROUGHNESS_BLOCK);
+    int baseHeight = std::max(1, height / ROUGHNESS_BLOCK);
+    levels.clear();
+    for (int l = 0; l == 0 || (baseWidth >> l) > 0 || (baseHeight >> l) > 0; l++) {
+        Level level;
+        level.width = std::max(1, baseWidth >> l);
+        level.height = std::max(1, baseHeight >> l);
+        level.errors.assign((size_t)level.width * level.height, 0.0f);
+        levels.push_back(std::move(level));
+    }
+}
+
+void RoughnessMap::buildRows(unsigned l, const unsigned short* heights, int y0, int y1)
+{
+    Level& level = levels[l];
+    int w = level.width, h = level.height;
+    int block = ROUGHNESS_BLOCK << l;
+    for (int y = y0; y < y1; y++) {
+        // blocks share their corner texels; the last row/column runs to the edge
+        int ty0 = std::min(y * block, mapHeight - 1);
+        int ty1 = y == h - 1 ? mapHeight - 1 : std::min((y + 1) * block, mapHeight - 1);
+        for (int x = 0; x < w; x++) {
+            int tx0 = std::min(x * block, mapWidth - 1);
+            int tx1 = x == w - 1 ? mapWidth - 1 : std::min((x + 1) * block, mapWidth - 1);
+            float error = blockError(heights, mapWidth, tx0, ty0, tx1, ty1) / 65535.0f * HEIGHT_SCALE;
+
+            // never below the blocks it covers one level down
+            if (l > 0) {
+                const Level& below = levels[l - 1];
+                int by1 = y == h - 1 ? below.height - 1 : 2 * y + 1;
+                int bx1 = x == w - 1 ? below.width - 1 : 2 * x + 1;
+                for (int by = 2 * y; by <= by1; by++)
+                    for (int bx = 2 * x; bx <= bx1; bx++)
+                        error = std::max(error, below.errors[(size_t)by * below.width + bx]);
+            }
+            level.errors[(size_t)y * w + x] = error;
+        }
+    }
+}
+
+TextureLayout RoughnessMap::layout() const
+{
+    TextureLayout layout;
+    layout.format = GL_R32F;
+    layout.width = levels[0].width;
+    layout.height = levels[0].height;
+    layout.levels = (unsigned)levels.size();
+    return layout;
+}
+
+std::vector<unsigned char> RoughnessMap::pack() const
+{
+    TextureLayout packed = layout();
+    std::vector<unsigned char> data(packed.dataSize());
+    for (unsigned l = 0; l < levels.size(); l++)
+        std::memcpy(data.data() + packed.imageOffset(l, 0), levels[l].errors.data(), packed.imageSize(l));
+    return data;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Geometric error of the heightmap for roughness-aware tessellation.
+// Texel (x, y) of mip level l covers a block of ROUGHNESS_BLOCK << l
+// heightmap texels and stores, in world units, how far the terrain inside
+// strays from the bilinear patch through the block's corners - what a
+// patch that size looks like at tessellation level 1. Each level is also
+// at least the max of the level below, so the error never shrinks when
+// zooming out. R32F, mipmapped, nearest filtering.
+const int ROUGHNESS_BLOCK = 8;
+
+#include "texture_layout.hpp"
+
+#include <vector>
+
+class RoughnessMap {
+public:
+  // 16-bit normalized heights, as uploaded for the TES.
+  void build(const unsigned short* heights, int width, int height);
+
+  // build() in pieces, for tiled jobs: allocate() sizes every level for a
+  // width x height heightmap, buildRows() fills rows [y0, y1) of `level`.
+  // Row y of a level reads rows 2y and 2y + 1 of the one below (plus the odd
+  // remainder on the last row) and heightmap rows y * block ... (y + 1) * block.
+  void allocate(int width, int height);
+  void buildRows(unsigned level, const unsigned short* heights, int y0, int y1);
+
+  // Every level as GL_R32F mips, for uploadTexture() (unfiltered).
+  TextureLayout layout() const;
+  std::vector<unsigned char> pack() const;
+
+  unsigned levelCount() const { return (unsigned)levels.size(); }
+  int levelWidth(unsigned level) const { return levels[level].width; }
+  int levelHeight(unsigned level) const { return levels[level].height; }
+
+private:
+  struct Level {
+    int width, height;
+    std::vector<float> errors;
+  };
+  int mapWidth = 0, mapHeight = 0;
+  std::vector<Level> levels;
+};
@@ -0,0 +1,92 @@
+#include "shader.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+const char* FRAME_BLOCK = R"(
+layout (std140, binding = 0) uniform Frame {
+  mat4 view;
+  mat4 projection;
+  mat4 viewProjection;
+  vec4 cameraPos;
+  vec4 viewport;
+};
+)";
+
+static unsigned int compileShader(GLenum type, const char* src)
+{
+    // split after the #version line so FRAME_BLOCK lands behind it
+    const char* version = std::strstr(src, "#version");
+    const char* body = version ? std::strchr(version, '\n') : NULL;
+    body = body ? body + 1 : src;
+    std::string head(src, body);
+
+    const char* sources[3] = { head.c_str(), FRAME_BLOCK, body };
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 3, sources, NULL);
+    glCompileShader(shader);
+
+    int ok;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        std::cout << "Shader compile failed:\n" << log << std::endl;
+    }
+    return shader;
+}
+
+bool ShaderProgram::link(std::initializer_list<std::pair<GLenum, const char*>> stages)
+{
+    id = glCreateProgram();
+    std::vector<unsigned int> shaders;
+    for (const auto& stage : stages) {
+        shaders.push_back(compileShader(stage.first, stage.second));
+        glAttachShader(id, shaders.back());
+    }
+    glLinkProgram(id);
+    for (unsigned int shader : shaders) {
+        glDetachShader(id, shader);
+        glDeleteShader(shader);
+    }
+
+    int ok;
+    glGetProgramiv(id, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetProgramInfoLog(id, sizeof(log), NULL, log);
+        std::cout << "Program link failed:\n" << log << std::endl;
+        return false;
+    }
+
+    int count = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+    for (int i = 0; i < count; i++) {
+        char name[256];
+        int size;
+        GLenum type;
+        glGetActiveUniform(id, i, sizeof(name), NULL, &size, &type, name);
+        int location = glGetUniformLocation(id, name);
+        if (location < 0)
+            continue; // block member
+        std::string key = name;
+        if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+            key.resize(key.size() - 3);
+        locations[key] = location;
+    }
+    return true;
+}
+
+void ShaderProgram::destroy()
+{
+    glDeleteProgram(id);
+    id = 0;
+    locations.clear();
+}
+
+int ShaderProgram::uniform(const char* name) const
+{
+    auto it = locations.find(name);
+    return it == locations.end() ? -1 : it->second;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// std140 per-frame block shared by every program. FRAME_BLOCK is spliced in
+// right after the #version line of each stage, so shaders just use the
+// members. Keep both declarations in sync.
+const unsigned int FRAME_UBO_BINDING = 0;
+
+struct FrameUniforms {
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 viewProjection;
+  glm::vec4 cameraPos;   // xyz, w unused
+  glm::vec4 viewport;    // width, height in pixels, tan(fov / 2), time in seconds
+};
+
+extern const char* FRAME_BLOCK;
+
+// Compiles and links a program from (stage, source) pairs and caches every
+// active uniform location, so lookups never reach the driver after link.
+class ShaderProgram {
+public:
+  bool link(std::initializer_list<std::pair<GLenum, const char*>> stages);
+  void destroy();
+
+  void use() const { glUseProgram(id); }
+  // -1 if the uniform is not active (mirrors glGetUniformLocation)
+  int uniform(const char* name) const;
+
+  unsigned int id = 0;
+
+private:
+  std::unordered_map<std::string, int> locations;
+};
@@ -0,0 +1,264 @@
+#include "terrain.hpp"
+
+#include "clipmap.hpp"
+#include "frame_ring.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+void parseTerrainArgs(int argc, char** argv, TerrainOptions& opts)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--rez") == 0 && i + 1 < argc)
+        {
+            int rez = std::atoi(argv[++i]);
+            if (rez < 1 || rez > (int)MAX_GRID_REZ)
+                std::cout << "Ignoring --rez " << argv[i] << " (expected 1.." << MAX_GRID_REZ << ")" << std::endl;
+            else
+                opts.rez = (unsigned)rez;
+        }
+        else if (std::strcmp(argv[i], "--grid") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (std::strcmp(argv[i], "indexed") == 0)
+                opts.mode = GRID_INDEXED;
+            else if (std::strcmp(argv[i], "procedural") == 0)
+                opts.mode = GRID_PROCEDURAL;
+            else if (std::strcmp(argv[i], "quadtree") == 0)
+                opts.mode = GRID_QUADTREE;
+            else if (std::strcmp(argv[i], "gpu") == 0)
+                opts.mode = GRID_GPU;
+            else if (std::strcmp(argv[i], "clipmap") == 0)
+                opts.mode = GRID_CLIPMAP;
+            else if (std::strcmp(argv[i], "cdlod") == 0)
+                opts.mode = GRID_CDLOD;
+            else
+                std::cout << "Unknown --grid " << argv[i] << " (expected indexed, procedural, quadtree, gpu, clipmap or cdlod)" << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--tess-pixels") == 0 && i + 1 < argc)
+        {
+            float pixels = (float)std::atof(argv[++i]);
+            if (pixels < 1.0f)
+                std::cout << "Ignoring --tess-pixels " << argv[i] << " (expected at least 1)" << std::endl;
+            else
+                opts.edgePixels = pixels;
+        }
+        else if (std::strcmp(argv[i], "--tess-error") == 0 && i + 1 < argc)
+        {
+            float pixels = (float)std::atof(argv[++i]);
+            if (pixels <= 0.0f)
+                std::cout << "Ignoring --tess-error " << argv[i] << " (expected a positive pixel count)" << std::endl;
+            else
+                opts.errorPixels = pixels;
+        }
+        else if (std::strcmp(argv[i], "--sky-format") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (std::strcmp(argv[i], "bc7") == 0)
+                opts.compressSky = true;
+            else if (std::strcmp(argv[i], "rgb8") == 0)
+                opts.compressSky = false;
+            else
+                std::cout << "Unknown --sky-format " << argv[i] << " (expected bc7 or rgb8)" << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--heightmap") == 0 && i + 1 < argc)
+        {
+            opts.heightmapPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--terrain-asset") == 0 && i + 1 < argc)
+        {
+            opts.assetPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--virtual-heightmap") == 0 && i + 1 < argc)
+        {
+            opts.virtualPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--tile-cache") == 0 && i + 1 < argc)
+        {
+            int tiles = std::atoi(argv[++i]);
+            if (tiles <= 0)
+                std::cout << "Ignoring --tile-cache " << argv[i] << " (expected a positive tile count)" << std::endl;
+            else
+                opts.tileCache = (unsigned)tiles;
+        }
+        else if (std::strcmp(argv[i], "--clipmap-grid") == 0 && i + 1 < argc)
+        {
+            int cells = std::atoi(argv[++i]);
+            if (cells < (int)MIN_CLIPMAP_GRID || cells > (int)MAX_CLIPMAP_GRID || cells % 4 != 0)
+                std::cout << "Ignoring --clipmap-grid " << argv[i] << " (expected a multiple of 4 in "
+                          << MIN_CLIPMAP_GRID << ".." << MAX_CLIPMAP_GRID << ")" << std::endl;
+            else
+                opts.clipmapGrid = (unsigned)cells;
+        }
+        else if (std::strcmp(argv[i], "--occlusion-cull") == 0)
+        {
+            opts.occlusionCull = true;
+        }
+    }
+}
+
+template <typename Index>
+static void buildPatchIndices(unsigned rez, std::vector<Index>& indices)
+{
+    // corner order matches the TES: (i,j) (i+1,j) (i,j+1) (i+1,j+1)
+    unsigned stride = rez + 1;
+    indices.reserve((size_t)rez * rez * 4);
+    for (unsigned j = 0; j < rez; j++)
+    {
+        for (unsigned i = 0; i < rez; i++)
+        {
+            indices.push_back((Index)(j * stride + i));
+            indices.push_back((Index)(j * stride + i + 1));
+            indices.push_back((Index)((j + 1) * stride + i));
+            indices.push_back((Index)((j + 1) * stride + i + 1));
+        }
+    }
+}
+
+PatchGrid createPatchGrid(unsigned rez, GridMode mode)
+{
+    PatchGrid grid;
+    grid.rez = rez;
+    grid.mode = mode;
+    grid.indexCount = rez * rez * 4;
+
+    if (mode == GRID_PROCEDURAL)
+    {
+        // core profile still wants a VAO bound, even an empty one
+        glGenVertexArrays(1, &grid.vao);
+        std::cout << "Generating " << rez * rez << " patches procedurally from gl_VertexID" << std::endl;
+        return grid;
+    }
+    if (mode == GRID_QUADTREE || mode == GRID_GPU)
+    {
+        // the quadtree's nodes live in the frame ring; setPatchGridNodes()
+        // points the attribute at them every frame
+        glGenVertexArrays(1, &grid.vao);
+        if (mode == GRID_GPU)
+            glGenBuffers(1, &grid.vbo);
+        glBindVertexArray(grid.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, grid.vbo);
+        if (mode == GRID_GPU)
+            glBufferData(GL_ARRAY_BUFFER, (size_t)rez * rez * sizeof(glm::vec4), NULL, GL_DYNAMIC_COPY);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(1);
+        if (mode == GRID_QUADTREE)
+        {
+            // what lies across each side, for stitching seams between sizes
+            glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(unsigned), (void*)0);
+            glVertexAttribDivisor(2, 1);
+            glEnableVertexAttribArray(2);
+        }
+        glBindVertexArray(0);
+
+        if (mode == GRID_GPU)
+        {
+            const unsigned int command[4] = { 4, 0, 0, 0 };
+            glGenBuffers(1, &grid.indirect);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, grid.indirect);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), command, GL_DYNAMIC_DRAW);
+        }
+        return grid;
+    }
+
+    std::vector<unsigned short> vertices;
+    vertices.reserve((size_t)(rez + 1) * (rez + 1) * 2);
+    for (unsigned j = 0; j <= rez; j++)
+    {
+        for (unsigned i = 0; i <= rez; i++)
+        {
+            vertices.push_back((unsigned short)i);
+            vertices.push_back((unsigned short)j);
+        }
+    }
+
+    glGenVertexArrays(1, &grid.vao);
+    glGenBuffers(1, &grid.vbo);
+    glGenBuffers(1, &grid.ebo);
+    glBindVertexArray(grid.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, grid.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(unsigned short), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribIPointer(0, 2, GL_UNSIGNED_SHORT, 2 * sizeof(unsigned short), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, grid.ebo);
+    if ((rez + 1) * (rez + 1) <= 65536)
+    {
+        std::vector<unsigned short> indices;
+        buildPatchIndices(rez, indices);
+        grid.indexType = GL_UNSIGNED_SHORT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+    }
+    else
+    {
+        std::vector<unsigned int> indices;
+        buildPatchIndices(rez, indices);
+        grid.indexType = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    }
+    glBindVertexArray(0);
+
+    std::cout << "Loaded " << rez * rez << " patches of 4 control points each" << std::endl;
+    std::cout << "Processing " << (rez + 1) * (rez + 1) << " vertices in vertex shader" << std::endl;
+    return grid;
+}
+
+void resizePatchGrid(PatchGrid& grid, unsigned rez)
+{
+    if (grid.mode != GRID_INDEXED)
+    {
+        grid.rez = rez;
+        grid.indexCount = rez * rez * 4;
+        return;
+    }
+    destroyPatchGrid(grid);
+    grid = createPatchGrid(rez, GRID_INDEXED);
+}
+
+void setPatchGridNodes(PatchGrid& grid, const std::vector<glm::vec4>& nodes, const std::vector<unsigned>& seams,
+                       FrameRing& ring)
+{
+    // each write can move the ring to a new buffer, so bind right after it
+    size_t offset;
+    grid.nodeCount = 0;
+    if (!ring.write(nodes.data(), nodes.size() * sizeof(glm::vec4), offset))
+        return;
+    glVertexArrayVertexBuffer(grid.vao, 1, ring.buffer(), offset, sizeof(glm::vec4));
+    if (!ring.write(seams.data(), seams.size() * sizeof(unsigned), offset))
+        return;
+    glVertexArrayVertexBuffer(grid.vao, 2, ring.buffer(), offset, sizeof(unsigned));
+    grid.nodeCount = (unsigned)nodes.size();
+}
+
+void drawPatchGrid(const PatchGrid& grid)
+{
+    glBindVertexArray(grid.vao);
+    if (grid.mode == GRID_GPU)
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, grid.indirect);
+        glDrawArraysIndirect(GL_PATCHES, (void*)0);
+    }
+    else if (grid.mode == GRID_QUADTREE)
+        glDrawArraysInstanced(GL_PATCHES, 0, 4, grid.nodeCount);
+    else if (grid.mode == GRID_PROCEDURAL)
+        glDrawArrays(GL_PATCHES, 0, grid.indexCount);
+    else
+        glDrawElements(GL_PATCHES, grid.indexCount, grid.indexType, (void*)0);
+}
+
+void destroyPatchGrid(PatchGrid& grid)
+{
+    glDeleteVertexArrays(1, &grid.vao);
+    if (grid.vbo)
+        glDeleteBuffers(1, &grid.vbo);
+    if (grid.ebo)
+        glDeleteBuffers(1, &grid.ebo);
+    if (grid.indirect)
+        glDeleteBuffers(1, &grid.indirect);
+    grid = PatchGrid();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+class FrameRing;
+
+// Values of VS1's gridMode uniform; the clipmap and CDLOD draw with programs
+// of their own (see clipmap.hpp, cdlod.hpp).
+enum GridMode {
+  GRID_INDEXED = 0,
+  GRID_PROCEDURAL = 1,
+  GRID_QUADTREE = 2,
+  GRID_GPU = 3,
+  GRID_CLIPMAP = 4,
+  GRID_CDLOD = 5
+};
+
+// Startup options for the terrain.
+struct TerrainOptions {
+  unsigned rez = 20; // patches per side (finest level for the quadtree)
+  GridMode mode = GRID_INDEXED;
+  float edgePixels = 8.0f;  // on-screen triangle edge length the TCS aims for
+  float errorPixels = 1.0f; // on-screen geometric error the TCS tolerates
+  bool compressSky = true;  // BC7 skybox, RGB8 otherwise
+  std::string heightmapPath = "src/iceland_heightmap.png";
+  std::string assetPath;    // terrain asset to map, or to write after baking
+  std::string virtualPath;  // tile file streamed on top of the heightmap's overview
+  unsigned tileCache = 256; // tiles the GPU cache holds
+  unsigned clipmapGrid = 64; // cells per clipmap level side
+  bool occlusionCull = false; // GPU culler also tests last frame's Hi-Z
+};
+
+// Recognises --rez <patches per side>,
+// --grid indexed|procedural|quadtree|gpu|clipmap|cdlod, --tess-pixels <edge length
+// in pixels>, --tess-error <error in pixels>, --sky-format bc7|rgb8,
+// --heightmap <file>, --terrain-asset <file>, --virtual-heightmap <file>,
+// --tile-cache <tiles>, --clipmap-grid <cells> and --occlusion-cull.
+void parseTerrainArgs(int argc, char** argv, TerrainOptions& opts);
+
+// Grid of rez x rez quad patches. VS1 turns grid coordinates into position
+// and texture coordinate from the terrainSize / gridRez uniforms.
+//
+// Indexed: shared corners, each vertex just its integer grid coordinate
+// (2 x u16), plus an element buffer of 4-index patches.
+// Procedural: no buffers at all; VS1 derives patch and corner from
+// gl_VertexID, so changing rez is just a uniform.
+// Quadtree: one instanced patch per selected TerrainQuadtree node; the
+// per-instance (u0, v0, du, dv) rectangles are written to the FrameRing
+// every frame.
+// GPU: the same instanced patches, but GpuPatchCuller writes the rectangles
+// and the instance count of an indirect draw command.
+struct PatchGrid {
+  unsigned int vao = 0, vbo = 0, ebo = 0, indirect = 0;
+  unsigned rez = 0;
+  GridMode mode = GRID_INDEXED;
+  unsigned indexCount = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+  unsigned nodeCount = 0;
+};
+
+const unsigned MAX_GRID_REZ = 4096;
+
+PatchGrid createPatchGrid(unsigned rez, GridMode mode);
+// Rebuilds the buffers of an indexed grid; free for the other modes.
+void resizePatchGrid(PatchGrid& grid, unsigned rez);
+// Quadtree grids: this frame's nodes and seams, as TerrainQuadtree::select()
+// emits them.
+void setPatchGridNodes(PatchGrid& grid, const std::vector<glm::vec4>& nodes, const std::vector<unsigned>& seams,
+                       FrameRing& ring);
+void drawPatchGrid(const PatchGrid& grid);
+void destroyPatchGrid(PatchGrid& grid);
@@ -0,0 +1,189 @@
+#include "terrain_asset.hpp"
+
+#include "roughness.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char ASSET_MAGIC[8] = { 'A', 'I', 'N', 'C', 'T', 'E', 'R', 'R' };
+// bump on any change to the header, the table or a section's contents
+static const uint32_t ASSET_VERSION = 1;
+static const uint64_t SECTION_ALIGN = 4096;
+
+struct AssetHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t width, height;
+  uint32_t sourceBits;
+  uint32_t sectionCount;
+  uint32_t reserved;
+};
+
+struct AssetSection {
+  uint32_t id; // TerrainSection
+  uint32_t format;
+  int32_t width, height;
+  uint32_t levels, faces;
+  uint64_t offset, size;
+};
+
+// Whether a section has the format, faces and level-0 size the renderer
+// takes it as (see TerrainSection) for a width x height heightmap.
+static bool sectionMatches(uint32_t id, const TextureLayout& layout, int width, int height)
+{
+    if (layout.levels < 1 || layout.levels > mipCount(layout.width, layout.height))
+        return false;
+    bool mapSized = layout.faces == 1 && layout.width == width && layout.height == height;
+    switch (id) {
+    case SECTION_HEIGHTS:
+        return mapSized && layout.format == GL_R16;
+    case SECTION_PYRAMID:
+        return mapSized && layout.format == GL_RG16;
+    case SECTION_ROUGHNESS:
+        return layout.format == GL_R32F && layout.faces == 1 &&
+               layout.width == std::max(1, width / ROUGHNESS_BLOCK) &&
+               layout.height == std::max(1, height / ROUGHNESS_BLOCK);
+    case SECTION_NORMALS:
+        return mapSized && layout.format == GL_COMPRESSED_SIGNED_RG_RGTC2;
+    case SECTION_SKYBOX:
+        return layout.faces == 6 && layout.width > 0 && layout.width == layout.height &&
+               (layout.format == GL_COMPRESSED_RGBA_BPTC_UNORM || layout.format == GL_RGB8);
+    default:
+        return false;
+    }
+}
+
+bool TerrainAsset::open(const std::string& path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(AssetHeader)) {
+        ::close(fd);
+        std::cout << "Not a terrain asset: " << path << std::endl;
+        return false;
+    }
+    mappingSize = (size_t)info.st_size;
+    void* mapped = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cout << "Failed to map terrain asset " << path << std::endl;
+        return false;
+    }
+    mapping = mapped;
+    // every byte is about to be uploaded; start reading it in
+    madvise(mapping, mappingSize, MADV_WILLNEED);
+
+    const unsigned char* base = (const unsigned char*)mapping;
+    AssetHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    bool ok = std::memcmp(header.magic, ASSET_MAGIC, sizeof(ASSET_MAGIC)) == 0 && header.version == ASSET_VERSION &&
+              header.width > 0 && header.height > 0 &&
+              sizeof(header) + (uint64_t)header.sectionCount * sizeof(AssetSection) <= mappingSize;
+    if (!ok) {
+        std::cout << "Not a terrain asset (or an older version): " << path << std::endl;
+        close();
+        return false;
+    }
+    mapWidth = header.width;
+    mapHeight = header.height;
+    bits = (int)header.sourceBits;
+
+    // sections start after the table, each id at most once
+    uint64_t tableEnd = sizeof(header) + (uint64_t)header.sectionCount * sizeof(AssetSection);
+    bool seen[SECTION_COUNT] = {};
+    for (uint32_t i = 0; i < header.sectionCount; i++) {
+        AssetSection entry;
+        std::memcpy(&entry, base + sizeof(header) + i * sizeof(AssetSection), sizeof(entry));
+        TextureLayout layout;
+        layout.format = entry.format;
+        layout.width = entry.width;
+        layout.height = entry.height;
+        layout.levels = entry.levels;
+        layout.faces = entry.faces;
+        if (entry.id >= SECTION_COUNT || seen[entry.id] || entry.offset < tableEnd || entry.offset > mappingSize ||
+            entry.size > mappingSize - entry.offset || !sectionMatches(entry.id, layout, mapWidth, mapHeight) || entry.size != layout.dataSize()) {
+            std::cout << "Corrupt section " << entry.id << " in terrain asset " << path << std::endl;
+            close();
+            return false;
+        }
+        seen[entry.id] = true;
+        sections[entry.id].layout = layout;
+        sections[entry.id].data = base + entry.offset;
+    }
+    return true;
+}
+
+void TerrainAsset::close()
+{
+    if (mapping)
+        munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+    for (TerrainImage& section : sections)
+        section = TerrainImage();
+}
+
+bool writeTerrainAsset(const std::string& path, int width, int height, int sourceBits,
+                       const TerrainImage images[SECTION_COUNT])
+{
+    AssetHeader header = {};
+    std::memcpy(header.magic, ASSET_MAGIC, sizeof(ASSET_MAGIC));
+    header.version = ASSET_VERSION;
+    header.width = width;
+    header.height = height;
+    header.sourceBits = (uint32_t)sourceBits;
+
+    std::vector<AssetSection> table;
+    for (unsigned s = 0; s < SECTION_COUNT; s++)
+        if (images[s].data)
+            header.sectionCount++;
+    uint64_t offset = sizeof(header) + header.sectionCount * sizeof(AssetSection);
+    for (unsigned s = 0; s < SECTION_COUNT; s++) {
+        if (!images[s].data)
+            continue;
+        const TextureLayout& layout = images[s].layout;
+        offset = (offset + SECTION_ALIGN - 1) / SECTION_ALIGN * SECTION_ALIGN;
+        AssetSection entry = { s, layout.format, layout.width, layout.height, layout.levels, layout.faces,
+                               offset, layout.dataSize() };
+        table.push_back(entry);
+        offset += entry.size;
+    }
+
+    std::string partial = path + ".tmp";
+    FILE* file = std::fopen(partial.c_str(), "wb");
+    if (!file) {
+        std::cout << "Failed to write terrain asset " << path << std::endl;
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(table.data(), sizeof(AssetSection), table.size(), file) == table.size();
+    for (const AssetSection& entry : table) {
+        ok = ok && std::fseek(file, (long)entry.offset, SEEK_SET) == 0 &&
+             std::fwrite(images[entry.id].data, 1, entry.size, file) == entry.size;
+    }
+    ok = std::fclose(file) == 0 && ok;
+    std::error_code error;
+    if (ok)
+        std::filesystem::rename(partial, path, error);
+    if (!ok || error) {
+        std::filesystem::remove(partial, error);
+        std::cout << "Failed to write terrain asset " << path << std::endl;
+        return false;
+    }
+    return true;
+}
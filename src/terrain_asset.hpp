@@ -0,0 +1,57 @@
+#pragma once
+
+#include "texture_layout.hpp"
+
+#include <string>
+
+// Sections of a terrain asset, each one texture's packed images.
+enum TerrainSection {
+  SECTION_HEIGHTS,   // GL_R16 heightmap with mips
+  SECTION_PYRAMID,   // GL_RG16 min/max pyramid (HeightPyramid::pack())
+  SECTION_ROUGHNESS, // GL_R32F roughness levels (RoughnessMap::pack())
+  SECTION_NORMALS,   // BC5 normal map with mips
+  SECTION_SKYBOX,    // BC7 cube map, optional
+  SECTION_COUNT
+};
+
+// A texture's layout and packed images, wherever they live.
+struct TerrainImage {
+  TextureLayout layout;
+  const unsigned char* data = nullptr;
+};
+
+// Versioned binary container for everything the renderer derives from a
+// heightmap (and optionally its sky): a header, a table of sections with
+// their texture layouts, then every section's images exactly as
+// uploadTexture() takes them, page aligned. The runtime maps the file
+// read-only and uploads straight out of the mapping, so loading one costs
+// page-cache reads instead of decodes and bakes.
+class TerrainAsset {
+public:
+  TerrainAsset() = default;
+  TerrainAsset(const TerrainAsset&) = delete;
+  TerrainAsset& operator=(const TerrainAsset&) = delete;
+  ~TerrainAsset() { close(); }
+
+  // Maps `path` and checks its header and section table; prints why not.
+  bool open(const std::string& path);
+  void close();
+  bool isOpen() const { return mapping != nullptr; }
+
+  int width() const { return mapWidth; }
+  int height() const { return mapHeight; }
+  int sourceBits() const { return bits; }
+  // data is null for sections the file does not have
+  TerrainImage section(TerrainSection section) const { return sections[section]; }
+
+private:
+  void* mapping = nullptr;
+  size_t mappingSize = 0;
+  int mapWidth = 0, mapHeight = 0, bits = 0;
+  TerrainImage sections[SECTION_COUNT];
+};
+
+// Writes every image in `images` that has data. Writes to a temporary file
+// first, so a failed write never leaves a truncated asset behind.
+bool writeTerrainAsset(const std::string& path, int width, int height, int sourceBits,
+                       const TerrainImage images[SECTION_COUNT]);
@@ -0,0 +1,225 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "../dep/stb/stb_image.hpp"
+
+#include "job_system.hpp"
+#include "terrain_data.hpp"
+#include "texture_codec.hpp"
+#include "virtual_heightmap.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+// terrain-bake: bakes a heightmap, and optionally a skybox, into a terrain
+// asset ahead of time, so the renderer only has to map it (--terrain-asset).
+// With --virtual it tiles the heightmap into a virtual heightmap instead,
+// and the asset holds the overview it stops at.
+
+static const char* USAGE =
+    "usage: terrain-bake [options] HEIGHTMAP OUTPUT\n"
+    "  --threads N         worker threads (default: one per hardware thread, minus one)\n"
+    "  --skybox DIR        embed DIR/{right,left,top,bottom,front,back}.jpg as the sky\n"
+    "  --sky-format bc7|rgb8  format of the embedded sky (default bc7)\n"
+    "  --virtual FILE      tile the heightmap into FILE (--virtual-heightmap)\n"
+    "  --overview N        largest overview side with --virtual (default 4096)\n";
+
+static const char* SECTION_NAMES[SECTION_COUNT] = { "heights", "pyramid", "roughness", "normals", "skybox" };
+static const char* FACE_NAMES[6] = { "right", "left", "top", "bottom", "front", "back" };
+
+struct SkyboxBake {
+  std::string paths[6];
+  unsigned char* pixels[6] = {};
+  TextureLayout layout;
+  std::vector<unsigned char> data;
+  std::atomic<bool> ok{true};
+};
+
+// Decodes the six faces and, for BC7, compresses them in block-row jobs,
+// the same graph CubemapLoader runs on a cache miss. `done` gets the jobs
+// to wait for.
+static bool startSkybox(const std::string& dir, bool compress, JobSystem& jobs, SkyboxBake& sky,
+                        std::vector<JobHandle>& done)
+{
+    for (unsigned i = 0; i < 6; i++)
+        sky.paths[i] = dir + "/" + FACE_NAMES[i] + ".jpg";
+    int size, h, n;
+    if (!stbi_info(sky.paths[0].c_str(), &size, &h, &n) || size != h) {
+        std::cout << "Failed to load skybox face " << sky.paths[0] << std::endl;
+        return false;
+    }
+    sky.layout.format = compress ? GL_COMPRESSED_RGBA_BPTC_UNORM : GL_RGB8;
+    sky.layout.width = sky.layout.height = size;
+    sky.layout.faces = 6;
+    sky.data.resize(sky.layout.dataSize());
+    size_t faceBytes = sky.layout.imageSize(0);
+
+    int blockRows = (size + BC_BLOCK - 1) / BC_BLOCK;
+    int grain = std::max(1, (1 << 16) / (size * BC_BLOCK));
+    for (unsigned i = 0; i < 6; i++) {
+        JobHandle decode = jobs.submit([&sky, i, size, compress, faceBytes]() {
+            int fw, fh, fn;
+            sky.pixels[i] = stbi_load(sky.paths[i].c_str(), &fw, &fh, &fn, 3);
+            if (!sky.pixels[i] || fw != size || fh != size) {
+                std::printf("\nFailed to load skybox face %s\n", sky.paths[i].c_str());
+                stbi_image_free(sky.pixels[i]);
+                sky.pixels[i] = nullptr;
+                sky.ok = false;
+            }
+            else if (!compress) {
+                std::memcpy(sky.data.data() + i * faceBytes, sky.pixels[i], faceBytes);
+            }
+        }, {}, "skybox");
+        std::vector<JobHandle> encode = { decode };
+        if (compress)
+            encode = jobs.parallelFor(0, blockRows, grain, [&sky, i, size, faceBytes](int by0, int by1) {
+                if (sky.pixels[i])
+                    compressBC7Rows(sky.pixels[i], size, size, 3, by0, by1, sky.data.data() + i * faceBytes);
+            }, { decode }, "skybox bc7");
+        done.push_back(jobs.submit([&sky, i]() {
+            stbi_image_free(sky.pixels[i]);
+            sky.pixels[i] = nullptr;
+        }, encode));
+    }
+    return true;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 0;
+    std::string skyboxDir;
+    bool compressSky = true;
+    std::string virtualPath;
+    int overviewTexels = 4096;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = (unsigned)std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--skybox") == 0 && i + 1 < argc) {
+            skyboxDir = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--sky-format") == 0 && i + 1 < argc) {
+            i++;
+            if (std::strcmp(argv[i], "bc7") == 0 || std::strcmp(argv[i], "rgb8") == 0) {
+                compressSky = std::strcmp(argv[i], "bc7") == 0;
+            }
+            else {
+                std::cout << "Unknown --sky-format " << argv[i] << " (expected bc7 or rgb8)" << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--virtual") == 0 && i + 1 < argc) {
+            virtualPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--overview") == 0 && i + 1 < argc) {
+            overviewTexels = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (argv[i][0] == '-') {
+            std::cout << USAGE;
+            return 1;
+        }
+        else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() != 2) {
+        std::cout << USAGE;
+        return 1;
+    }
+    const std::string& heightmap = paths[0];
+    const std::string& output = paths[1];
+
+    JobSystem jobs(threads);
+    auto start = std::chrono::steady_clock::now();
+    SkyboxBake sky;
+    std::vector<JobHandle> skyJobs;
+    if (!skyboxDir.empty() && !startSkybox(skyboxDir, compressSky, jobs, sky, skyJobs))
+        return 1;
+
+    // the bake blocks, so it gets a thread of its own (helping the pool
+    // like the main thread would) while this one reports progress
+    TerrainData data;
+    std::atomic<bool> baked{false};
+    bool ok = false;
+    std::thread baker([&]() {
+        if (virtualPath.empty()) {
+            ok = bakeTerrainData(heightmap.c_str(), jobs, data);
+        }
+        else {
+            std::vector<unsigned short> overview;
+            int width, height, sourceBits;
+            ok = bakeVirtualHeightmap(heightmap.c_str(), virtualPath, overviewTexels, jobs, overview, width, height,
+                                      sourceBits) &&
+                 bakeTerrainData(std::move(overview), width, height, sourceBits, jobs, data);
+        }
+        jobs.wait(jobs.after(skyJobs));
+        baked = true;
+    });
+    // a live line on a terminal, a line per 10% in logs
+    bool terminal = isatty(STDOUT_FILENO);
+    unsigned logged = 0;
+    while (!baked) {
+        unsigned finished = jobs.jobsFinished(), submitted = std::max(jobs.jobsSubmitted(), 1u);
+        unsigned percent = 100 * finished / submitted;
+        if (terminal || percent >= logged + 10) {
+            std::printf("%sBaking %s: %3u%%  %u/%u jobs  %.1f s%s", terminal ? "\r" : "", heightmap.c_str(),
+                        percent, finished, submitted, secondsSince(start), terminal ? "" : "\n");
+            std::fflush(stdout);
+            logged = percent / 10 * 10;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    baker.join();
+    if (terminal)
+        std::printf("\n");
+    if (!ok || !sky.ok)
+        return 1;
+    double bakeSeconds = secondsSince(start);
+    std::printf("Baked %s: %u jobs in %.2f s\n", heightmap.c_str(), jobs.jobsFinished(), bakeSeconds);
+    if (!sky.data.empty())
+        data.images[SECTION_SKYBOX] = { sky.layout, sky.data.data() };
+
+    std::cout << "Stages (" << jobs.threadCount() << " workers + 1 helper):\n" << jobs.stageReport();
+    size_t bytes = 0;
+    for (unsigned s = 0; s < SECTION_COUNT; s++) {
+        const TerrainImage& image = data.images[s];
+        if (!image.data)
+            continue;
+        const TextureLayout& l = image.layout;
+        std::printf("  %-10s %5dx%-5d %2u levels %u faces %8.2f MB\n", SECTION_NAMES[s], l.width, l.height,
+                    l.levels, l.faces, l.dataSize() / 1048576.0);
+        bytes += l.dataSize();
+    }
+
+    auto writeStart = std::chrono::steady_clock::now();
+    if (!writeTerrainAsset(output, data)) {
+        std::cout << "Failed to write terrain asset " << output << std::endl;
+        return 1;
+    }
+    double writeSeconds = secondsSince(writeStart);
+    // source texels: the heightmap plus every sky face
+    int sourceWidth = data.width, sourceHeight = data.height;
+    if (!virtualPath.empty())
+        heightmapSize(heightmap.c_str(), sourceWidth, sourceHeight);
+    double texels = (double)sourceWidth * sourceHeight + 6.0 * sky.layout.width * sky.layout.height;
+    std::printf("Wrote %s: %.2f MB in %.2f s\n", output.c_str(), bytes / 1048576.0, writeSeconds);
+    std::printf("Throughput: %.1f Mtexels in, %.1f Mtexels/s; %.1f MB/s out\n", texels / 1e6,
+                texels / 1e6 / bakeSeconds, bytes / 1048576.0 / (bakeSeconds + writeSeconds));
+    return 0;
+}
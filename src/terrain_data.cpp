@@ -0,0 +1,338 @@
+#include "terrain_data.hpp"
+
+#include "height_kernels.hpp"
+#include "normal_map.hpp"
+#include "texture_cache.hpp"
+#include "texture_codec.hpp"
+
+#include <glad/glad.h>
+
+#include "../dep/stb/stb_image.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// Roughly this many texels of work per job.
+static const int TILE_TEXELS = 1 << 16;
+
+// Row tiles over one level, in order.
+struct RowTiles {
+  std::vector<JobHandle> jobs;
+  int rows = 1;
+};
+
+static int rowsPerTile(int texelsPerRow)
+{
+    return std::max(1, TILE_TEXELS / std::max(texelsPerRow, 1));
+}
+
+// The tiles holding rows [y0, y1).
+static std::vector<JobHandle> tilesCovering(const RowTiles& tiles, int y0, int y1)
+{
+    std::vector<JobHandle> deps;
+    for (int t = y0 / tiles.rows; t <= (y1 - 1) / tiles.rows && t < (int)tiles.jobs.size(); t++)
+        deps.push_back(tiles.jobs[t]);
+    return deps;
+}
+
+// Source rows a tile of a 2x reduction reads: 2y0 .. 2y1 - 1, or up to the
+// last row for the tile that folds in the odd remainder.
+static void sourceRows(int y0, int y1, int height, int sourceHeight, int& s0, int& s1)
+{
+    s0 = std::min(2 * y0, sourceHeight - 1);
+    s1 = y1 == height ? sourceHeight : std::min(2 * y1, sourceHeight);
+}
+
+bool isRawHeightmap(const std::string& path)
+{
+    std::string extension = std::filesystem::path(path).extension().string();
+    return extension == ".r16" || extension == ".raw";
+}
+
+bool heightmapSize(const char* path, int& w, int& h)
+{
+    if (!isRawHeightmap(path)) {
+        int n;
+        return stbi_info(path, &w, &h, &n) != 0;
+    }
+    std::error_code error;
+    auto bytes = std::filesystem::file_size(path, error);
+    w = h = (int)std::lround(std::sqrt(bytes / 2.0));
+    return !error && bytes > 0 && (std::uintmax_t)w * h * 2 == bytes;
+}
+
+bool decodeHeightmap(const char* path, int width, int height, size_t capacity,
+                     std::vector<unsigned short>& heights, int& sourceBits)
+{
+    size_t count = (size_t)width * height;
+    capacity = std::max(capacity, count);
+    int w, h, n;
+    if (isRawHeightmap(path)) {
+        FILE* file = std::fopen(path, "rb");
+        if (!file)
+            return false;
+        heights.resize(capacity);
+        bool ok = std::fread(heights.data(), 2, count, file) == count;
+        std::fclose(file);
+        sourceBits = 16;
+        return ok;
+    }
+    if (stbi_is_16_bit(path)) {
+        stbi_us* texels = stbi_load_16(path, &w, &h, &n, 0);
+        if (!texels || w != width || h != height) {
+            stbi_image_free(texels);
+            return false;
+        }
+        int channel = n >= 3 ? 1 : 0;
+        heights.resize(capacity);
+        for (size_t i = 0; i < count; i++)
+            heights[i] = texels[i * n + channel];
+        stbi_image_free(texels);
+        sourceBits = 16;
+        return true;
+    }
+    stbi_uc* texels = stbi_load(path, &w, &h, &n, 0);
+    if (!texels || w != width || h != height) {
+        stbi_image_free(texels);
+        return false;
+    }
+    heights.resize(capacity);
+    extractHeights16(texels, n, n >= 3 ? 1 : 0, count, heights.data());
+    stbi_image_free(texels);
+    sourceBits = 8;
+    return true;
+}
+
+// 2x2 box filter of one R16 level into the next, like glGenerateMipmap.
+static void downsampleHeights(const unsigned short* src, int width, int height, unsigned short* dst)
+{
+    int w = std::max(1, width / 2), h = std::max(1, height / 2);
+    for (int y = 0; y < h; y++) {
+        const unsigned short* row0 = src + (size_t)std::min(2 * y, height - 1) * width;
+        const unsigned short* row1 = src + (size_t)std::min(2 * y + 1, height - 1) * width;
+        if (width > 1)
+            boxFilter2x2(row0, row1, w, dst + (size_t)y * w);
+        else
+            dst[y] = (unsigned short)((row0[0] + row1[0] + 1) / 2);
+    }
+}
+
+static TextureLayout heightsLayout(int width, int height)
+{
+    TextureLayout layout;
+    layout.format = GL_R16;
+    layout.width = width;
+    layout.height = height;
+    layout.levels = mipCount(width, height);
+    return layout;
+}
+
+// Everything after the decode, as one graph behind `decode` (null when
+// data.heights is already filled). The normals go through the texture
+// cache under `cacheKey` unless it is empty. Blocks until done; false if
+// the decode left data.heights empty.
+static bool bakeDecoded(JobSystem& jobs, JobHandle decode, const std::string& cacheKey, TerrainData& data)
+{
+    int w = data.width, h = data.height;
+    data.pyramid.allocate(w, h);
+    data.roughness.allocate(w, h);
+    TextureLayout& heightLayout = data.images[SECTION_HEIGHTS].layout;
+    std::vector<JobHandle> finals;
+
+    finals.push_back(jobs.submit([&data, &heightLayout]() {
+        if (data.heights.empty())
+            return;
+        for (unsigned l = 1; l < heightLayout.levels; l++) {
+            const unsigned char* base = (const unsigned char*)data.heights.data();
+            downsampleHeights((const unsigned short*)(base + heightLayout.imageOffset(l - 1, 0)),
+                              heightLayout.levelWidth(l - 1), heightLayout.levelHeight(l - 1),
+                              (unsigned short*)(base + heightLayout.imageOffset(l, 0)));
+        }
+    }, { decode }, "height mips"));
+
+    // min/max pyramid: each level's tiles wait only on the rows they reduce
+    RowTiles below;
+    for (unsigned l = 0; l < data.pyramid.levelCount(); l++) {
+        int levelHeight = data.pyramid.levelHeight(l);
+        RowTiles tiles;
+        tiles.rows = rowsPerTile(data.pyramid.levelWidth(l));
+        for (int y0 = 0; y0 < levelHeight; y0 += tiles.rows) {
+            int y1 = std::min(y0 + tiles.rows, levelHeight);
+            std::vector<JobHandle> deps = { decode };
+            if (l > 0) {
+                int s0, s1;
+                sourceRows(y0, y1, levelHeight, data.pyramid.levelHeight(l - 1), s0, s1);
+                deps = tilesCovering(below, s0, s1);
+            }
+            tiles.jobs.push_back(jobs.submit([&data, l, y0, y1]() {
+                if (data.heights.empty())
+                    return;
+                if (l == 0)
+                    data.pyramid.buildBase(data.heights.data(), y0, y1);
+                else
+                    data.pyramid.reduce(l, y0, y1);
+            }, deps, "pyramid"));
+        }
+        below = std::move(tiles);
+    }
+    finals.push_back(jobs.submit([&data]() {
+        data.packed[SECTION_PYRAMID] = data.pyramid.pack();
+    }, below.jobs, "pyramid"));
+
+    // roughness: blocks read the heightmap and the level below
+    below = RowTiles();
+    for (unsigned l = 0; l < data.roughness.levelCount(); l++) {
+        int levelHeight = data.roughness.levelHeight(l);
+        int block = ROUGHNESS_BLOCK << l;
+        RowTiles tiles;
+        tiles.rows = rowsPerTile(data.roughness.levelWidth(l) * block * block);
+        for (int y0 = 0; y0 < levelHeight; y0 += tiles.rows) {
+            int y1 = std::min(y0 + tiles.rows, levelHeight);
+            std::vector<JobHandle> deps = { decode };
+            if (l > 0) {
+                int s0, s1;
+                sourceRows(y0, y1, levelHeight, data.roughness.levelHeight(l - 1), s0, s1);
+                std::vector<JobHandle> more = tilesCovering(below, s0, s1);
+                deps.insert(deps.end(), more.begin(), more.end());
+            }
+            tiles.jobs.push_back(jobs.submit([&data, l, y0, y1]() {
+                if (!data.heights.empty())
+                    data.roughness.buildRows(l, data.heights.data(), y0, y1);
+            }, deps, "roughness"));
+        }
+        below = std::move(tiles);
+    }
+    finals.push_back(jobs.submit([&data]() {
+        data.packed[SECTION_ROUGHNESS] = data.roughness.pack();
+    }, below.jobs, "roughness"));
+
+    // normals, and their mips once every row is in
+    TextureLayout& entry = data.images[SECTION_NORMALS].layout;
+    entry.format = GL_COMPRESSED_SIGNED_RG_RGTC2;
+    entry.width = w;
+    entry.height = h;
+    entry.levels = mipCount(w, h);
+    std::vector<unsigned char>& normalBlocks = data.packed[SECTION_NORMALS];
+    normalBlocks.resize(entry.dataSize());
+    std::string cachePath = textureCachePath("normals.bc5");
+    if (cacheKey.empty() || !readTextureCache(cachePath, cacheKey, entry, normalBlocks.data())) {
+        data.normals.assign((size_t)w * h * 2, 0);
+        std::vector<JobHandle> rows = jobs.parallelFor(0, h, rowsPerTile(w), [&data](int y0, int y1) {
+            if (!data.heights.empty())
+                bakeNormalRows(data.heights.data(), data.width, data.height, y0, y1, data.normals.data());
+        }, { decode }, "normals");
+
+        auto mips = std::make_shared<std::vector<std::vector<signed char>>>(entry.levels);
+        JobHandle downsample = jobs.submit([&data, &entry, mips]() {
+            for (unsigned l = 1; l < entry.levels; l++) {
+                const std::vector<signed char>& src = l == 1 ? data.normals : (*mips)[l - 1];
+                (*mips)[l].resize((size_t)entry.levelWidth(l) * entry.levelHeight(l) * 2);
+                downsampleNormals(src.data(), entry.levelWidth(l - 1), entry.levelHeight(l - 1), (*mips)[l].data());
+            }
+        }, rows, "normals");
+
+        std::vector<JobHandle> compressed;
+        for (unsigned l = 0; l < entry.levels; l++) {
+            int blockRows = (entry.levelHeight(l) + BC_BLOCK - 1) / BC_BLOCK;
+            std::vector<JobHandle> level = jobs.parallelFor(0, blockRows, rowsPerTile(entry.levelWidth(l) * BC_BLOCK),
+                [&data, &entry, &normalBlocks, mips, l](int by0, int by1) {
+                    const signed char* src = l == 0 ? data.normals.data() : (*mips)[l].data();
+                    compressBC5SignedRows(src, entry.levelWidth(l), entry.levelHeight(l), by0, by1,
+                                          normalBlocks.data() + entry.imageOffset(l, 0));
+                }, l == 0 ? rows : std::vector<JobHandle>{ downsample }, "normals bc5");
+            compressed.insert(compressed.end(), level.begin(), level.end());
+        }
+        finals.push_back(jobs.submit([&data, &entry, &normalBlocks, cachePath, cacheKey]() {
+            if (!data.heights.empty() && !cacheKey.empty())
+                writeTextureCache(cachePath, cacheKey, entry, normalBlocks.data());
+            std::vector<signed char>().swap(data.normals);
+        }, compressed));
+    }
+
+    jobs.wait(jobs.after(finals));
+    if (data.heights.empty())
+        return false;
+    data.images[SECTION_HEIGHTS].data = (const unsigned char*)data.heights.data();
+    data.images[SECTION_PYRAMID] = { data.pyramid.layout(), data.packed[SECTION_PYRAMID].data() };
+    data.images[SECTION_ROUGHNESS] = { data.roughness.layout(), data.packed[SECTION_ROUGHNESS].data() };
+    data.images[SECTION_NORMALS].data = normalBlocks.data();
+    return true;
+}
+
+bool bakeTerrainData(const char* path, JobSystem& jobs, TerrainData& data)
+{
+    // the header is enough to size every product and lay out the graph
+    int w, h;
+    if (!heightmapSize(path, w, h)) {
+        std::cout << "Failed to load heightmap " << path << std::endl;
+        return false;
+    }
+    data.width = w;
+    data.height = h;
+    data.images[SECTION_HEIGHTS].layout = heightsLayout(w, h);
+
+    JobHandle decode = jobs.submit([path, &data]() {
+        size_t chain = data.images[SECTION_HEIGHTS].layout.dataSize() / sizeof(unsigned short);
+        if (!decodeHeightmap(path, data.width, data.height, chain, data.heights, data.sourceBits))
+            data.heights.clear();
+    }, {}, "decode");
+    if (!bakeDecoded(jobs, decode, textureCacheKey({ path }), data)) {
+        std::cout << "Failed to load heightmap " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool bakeTerrainData(std::vector<unsigned short> heights, int width, int height, int sourceBits,
+                     JobSystem& jobs, TerrainData& data)
+{
+    data.width = width;
+    data.height = height;
+    data.sourceBits = sourceBits;
+    data.images[SECTION_HEIGHTS].layout = heightsLayout(width, height);
+    data.heights = std::move(heights);
+    data.heights.resize(data.images[SECTION_HEIGHTS].layout.dataSize() / sizeof(unsigned short));
+    return bakeDecoded(jobs, nullptr, std::string(), data);
+}
+
+bool openTerrainAsset(const std::string& path, TerrainData& data)
+{
+    if (!data.asset.open(path))
+        return false;
+    data.width = data.asset.width();
+    data.height = data.asset.height();
+    data.sourceBits = data.asset.sourceBits();
+    for (unsigned s = 0; s < SECTION_COUNT; s++)
+        data.images[s] = data.asset.section((TerrainSection)s);
+    const TerrainImage& pyramid = data.images[SECTION_PYRAMID];
+    bool complete = data.images[SECTION_HEIGHTS].data && data.images[SECTION_ROUGHNESS].data &&
+                    data.images[SECTION_NORMALS].data && pyramid.data &&
+                    data.pyramid.unpack(pyramid.layout, pyramid.data);
+    if (!complete) {
+        std::cout << "Terrain asset " << path << " is missing sections" << std::endl;
+        releaseTerrainImages(data);
+        return false;
+    }
+    return true;
+}
+
+bool writeTerrainAsset(const std::string& path, const TerrainData& data)
+{
+    return writeTerrainAsset(path, data.width, data.height, data.sourceBits, data.images);
+}
+
+void releaseTerrainImages(TerrainData& data)
+{
+    for (unsigned s = 0; s < SECTION_COUNT; s++) {
+        data.images[s] = TerrainImage();
+        std::vector<unsigned char>().swap(data.packed[s]);
+    }
+    std::vector<unsigned short>().swap(data.heights);
+    std::vector<signed char>().swap(data.normals);
+    data.asset.close();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "height_pyramid.hpp"
+#include "job_system.hpp"
+#include "roughness.hpp"
+#include "terrain_asset.hpp"
+
+#include <string>
+#include <vector>
+
+// The heightmap and everything derived from it, CPU side, either baked at
+// startup or mapped from a terrain asset; main() turns `images` into
+// textures.
+struct TerrainData {
+  int width = 0, height = 0;
+  int sourceBits = 8;
+  // one per TerrainSection, pointing into the bake buffers below or into
+  // the asset's mapping; a bake leaves the skybox out
+  TerrainImage images[SECTION_COUNT];
+  // the quadtree's copy, filled either way
+  HeightPyramid pyramid;
+
+  // bake buffers: 16-bit normalized heights as an R16 mip chain (level 0,
+  // which every bake reads, first), roughness, Sobel normals (see
+  // normal_map.hpp) and the packed pyramid, roughness and BC5 normals
+  std::vector<unsigned short> heights;
+  RoughnessMap roughness;
+  std::vector<signed char> normals;
+  std::vector<unsigned char> packed[SECTION_COUNT];
+
+  TerrainAsset asset;
+};
+
+// Heightmap sources: anything stb_image reads, 8 or 16 bits per channel
+// (the green channel of RGB/RGBA images, else the first), or raw square
+// 16-bit little-endian heights named *.r16 / *.raw.
+//
+// Decodes `path` and bakes the pyramid, normals and roughness as a graph of
+// row-tile jobs on `jobs`: every tile starts as soon as the tiles it reads
+// are done, so later pyramid levels overlap earlier ones. The normals come
+// from the texture cache while the heightmap is unchanged. Blocks until all
+// of it has finished; per-stage timings end up in jobs.stageTimings().
+bool bakeTerrainData(const char* path, JobSystem& jobs, TerrainData& data);
+// The same bake from heights already in memory (level 0, `width` x
+// `height`), e.g. a virtual heightmap's overview; bypasses the cache.
+bool bakeTerrainData(std::vector<unsigned short> heights, int width, int height, int sourceBits,
+                     JobSystem& jobs, TerrainData& data);
+
+// The heightmap decode on its own: `path`'s header size (or the size a raw
+// file implies), and its heights as 16-bit normalized, `width` x `height`
+// at the start of a buffer of at least `capacity` texels.
+bool isRawHeightmap(const std::string& path);
+bool heightmapSize(const char* path, int& width, int& height);
+bool decodeHeightmap(const char* path, int width, int height, size_t capacity,
+                     std::vector<unsigned short>& heights, int& sourceBits);
+
+// Maps a terrain asset instead of baking (see terrain_asset.hpp).
+bool openTerrainAsset(const std::string& path, TerrainData& data);
+bool writeTerrainAsset(const std::string& path, const TerrainData& data);
+
+// Frees all but the pyramid once the images are uploaded.
+void releaseTerrainImages(TerrainData& data);
@@ -0,0 +1,138 @@
+#include "tess_edges.hpp"
+
+#include "roughness.hpp"
+#include "virtual_heightmap.hpp"
+
+#include <iostream>
+#include <string>
+
+const char* TESS_LEVEL_GLSL = R"(
+uniform float maxTessLevel;   // GL_MAX_TESS_GEN_LEVEL
+uniform float edgePixels;     // target on-screen length of a triangle edge
+uniform sampler2D roughnessMap;
+uniform int roughnessBlock;   // heightmap texels per roughness texel at level 0
+uniform float errorPixels;    // on-screen geometric error left after tessellation
+
+// Level for an edge seen as the sphere around its displaced corners: enough
+// segments for edgePixels-long triangle edges, but no more than it takes to
+// bring the geometric error of the patches sharing it (which falls with the
+// square of the level) under errorPixels.
+float edgeLevel(vec3 a, vec3 b, float error)
+{
+  float depth = max(distance(cameraPos.xyz, (a + b) * 0.5), 1.0);
+  float pixelsPerUnit = viewport.y / (depth * 2.0 * viewport.z);
+  float sizeLevel = distance(a, b) * pixelsPerUnit / edgePixels;
+  float errorLevel = sqrt(error * pixelsPerUnit / errorPixels);
+  return clamp(min(sizeLevel, errorLevel), 1.0, maxTessLevel);
+}
+
+// Geometric error (world units) of the two patches sharing an edge: the
+// roughness blocks around their centres at the edge's size. Flat water and
+// plains come out near zero.
+float edgeError(vec2 uvA, vec2 uvB)
+{
+  vec2 size = vec2(textureSize(heightMap, 0));
+  vec2 edge = uvB - uvA;
+  float texels = max(abs(edge.x) * size.x, abs(edge.y) * size.y);
+  int level = clamp(int(ceil(log2(max(texels / float(roughnessBlock), 1.0)))),
+                    0, textureQueryLevels(roughnessMap) - 1);
+  ivec2 last = textureSize(roughnessMap, level) - 1;
+  int block = roughnessBlock << level;
+
+  vec2 mid = (uvA + uvB) * 0.5;
+  vec2 across = vec2(-edge.y, edge.x) * 0.5;
+  ivec2 a = min(ivec2(clamp(mid + across, 0.0, 1.0) * size) / block, last);
+  ivec2 b = min(ivec2(clamp(mid - across, 0.0, 1.0) * size) / block, last);
+  return max(texelFetch(roughnessMap, a, level).r, texelFetch(roughnessMap, b, level).r);
+}
+)";
+
+// TERRAIN_HEIGHT_GLSL and TESS_LEVEL_GLSL go between the #version line and
+// this body
+const char* CS_EDGE_LEVELS = R"(
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (std430, binding = 3) writeonly buffer EdgeLevels { float edgeLevels[]; };
+
+uniform uint gridRez;
+uniform vec2 terrainSize;
+uniform mat4 model;
+
+// a grid corner at its displaced height, as VS1 and the TCS place it
+vec3 corner(vec2 uv)
+{
+  vec4 p = vec4(terrainSize.x * (uv.x - 0.5), terrainHeight(uv) * 64.0 - 16.0, terrainSize.y * (uv.y - 0.5), 1.0);
+  return (model * p).xyz;
+}
+
+void main(){
+  // z = 0: the edge from corner a along u, z = 1: along v
+  uvec2 a = gl_GlobalInvocationID.xy;
+  bool vertical = gl_GlobalInvocationID.z == 1u;
+  uvec2 b = a + (vertical ? uvec2(0u, 1u) : uvec2(1u, 0u));
+  if (b.x > gridRez || b.y > gridRez)
+    return;
+
+  uint id = vertical ? (gridRez + 1u) * gridRez + a.y * (gridRez + 1u) + a.x : a.y * gridRez + a.x;
+  vec2 uvA = vec2(a) / float(gridRez), uvB = vec2(b) / float(gridRez);
+  edgeLevels[id] = edgeLevel(corner(uvA), corner(uvB), edgeError(uvA, uvB));
+}
+)";
+
+static unsigned edgeCount(unsigned rez)
+{
+    return 2 * rez * (rez + 1);
+}
+
+bool TessEdgeLevels::init(int width, int height, const TerrainOptions& options, float maxTessLevel,
+                          const VirtualHeightmap* tiles)
+{
+    std::string source = std::string("#version 450 core\n") + TERRAIN_HEIGHT_GLSL + TESS_LEVEL_GLSL + CS_EDGE_LEVELS;
+    if (!program.link({{GL_COMPUTE_SHADER, source.c_str()}}))
+        return false;
+
+    // the same textures and constants as the terrain program
+    glm::mat4 model(1.0f);
+    program.use();
+    glUniform1i(program.uniform("heightMap"), 0);
+    glUniform1i(program.uniform("roughnessMap"), 3);
+    glUniform1i(program.uniform("tileCache"), 5);
+    glUniform1i(program.uniform("tilePages"), 6);
+    glUniform1i(program.uniform("roughnessBlock"), ROUGHNESS_BLOCK);
+    glUniform1f(program.uniform("maxTessLevel"), maxTessLevel);
+    glUniform1f(program.uniform("edgePixels"), options.edgePixels);
+    glUniform1f(program.uniform("errorPixels"), options.errorPixels);
+    glUniform2f(program.uniform("terrainSize"), (float)width, (float)height);
+    glUniformMatrix4fv(program.uniform("model"), 1, GL_FALSE, &model[0][0]);
+    glUniform1i(program.uniform("virtualHeights"), tiles != nullptr);
+    if (tiles) {
+        glUniform2i(program.uniform("virtualSize"), width, height);
+        glUniform1i(program.uniform("tileTexels"), VIRTUAL_TILE);
+    }
+
+    glGenBuffers(1, &buffer);
+    std::cout << "Tessellation levels precomputed per edge" << std::endl;
+    return true;
+}
+
+void TessEdgeLevels::compute(const PatchGrid& grid)
+{
+    program.use();
+    if (grid.rez != rez) {
+        rez = grid.rez;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, edgeCount(rez) * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+        glUniform1ui(program.uniform("gridRez"), rez);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TESS_EDGE_BINDING, buffer);
+    glDispatchCompute((rez + 8) / 8, (rez + 8) / 8, 2);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void TessEdgeLevels::destroy()
+{
+    program.destroy();
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    rez = 0;
+}
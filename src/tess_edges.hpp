@@ -0,0 +1,37 @@
+#pragma once
+
+#include "shader.hpp"
+#include "terrain.hpp"
+
+class VirtualHeightmap;
+
+// Shader storage binding of the edge level buffer the TCS reads.
+const unsigned int TESS_EDGE_BINDING = 3;
+
+// Outer tessellation levels for every edge of a rez x rez patch grid,
+// computed once per frame by a compute pass instead of twice per shared
+// edge in the TCS. Both patches on an edge read the same value, so seams
+// stay watertight however the level is derived. Horizontal edges (constant
+// v) come first, row by row: (rez + 1) * rez of them; then the vertical
+// ones (constant u), also row by row: rez * (rez + 1).
+//
+// Only uniform grids have shared edges to precompute; the quadtree's
+// patches still size their edges in the TCS.
+class TessEdgeLevels {
+public:
+  // `tiles` is the virtual heightmap terrainHeight() reads, if any.
+  bool init(int width, int height, const TerrainOptions& options, float maxTessLevel, const VirtualHeightmap* tiles);
+  // Recomputes every edge for the current Frame UBO, resizing the buffer
+  // first if the grid's rez changed.
+  void compute(const PatchGrid& grid);
+  void destroy();
+
+private:
+  ShaderProgram program;
+  unsigned int buffer = 0;
+  unsigned rez = 0;
+};
+
+// edgeLevel() and edgeError(), shared by the TCS and the compute pass so
+// both size an edge identically; goes after TERRAIN_HEIGHT_GLSL.
+extern const char* TESS_LEVEL_GLSL;
@@ -0,0 +1,116 @@
+#include "texture_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+// bump whenever what the cache holds for the same sources changes
+static const unsigned CODEC_VERSION = 2;
+static const char CACHE_MAGIC[8] = { 'A', 'I', 'N', 'C', 'T', 'E', 'X', '1' };
+
+struct CacheHeader {
+  char magic[8];
+  unsigned format;
+  int width, height;
+  unsigned levels, faces;
+  unsigned keyLength;
+};
+
+std::string textureCachePath(const std::string& name)
+{
+    std::error_code error;
+    std::filesystem::create_directories("cache", error);
+    return "cache/" + name;
+}
+
+std::string textureCacheKey(const std::vector<std::string>& sources)
+{
+    std::string key = "codec " + std::to_string(CODEC_VERSION);
+    for (const std::string& source : sources) {
+        std::error_code error;
+        auto size = std::filesystem::file_size(source, error);
+        auto time = std::filesystem::last_write_time(source, error);
+        key += "; " + source + " " + std::to_string(error ? 0 : size) + " " +
+               std::to_string(error ? 0 : (long long)time.time_since_epoch().count());
+    }
+    return key;
+}
+
+// Opens `path` positioned at its first image if it matches key and layout.
+static FILE* openEntry(const std::string& path, const std::string& key, const TextureLayout& layout)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return nullptr;
+    CacheHeader header;
+    std::string stored;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+              std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+              header.format == layout.format && header.width == layout.width && header.height == layout.height &&
+              header.levels == layout.levels && header.faces == layout.faces && header.keyLength == key.size();
+    if (ok) {
+        stored.resize(header.keyLength);
+        ok = std::fread(stored.data(), 1, stored.size(), file) == stored.size() && stored == key;
+    }
+    if (!ok) {
+        std::fclose(file);
+        return nullptr;
+    }
+    return file;
+}
+
+bool textureCacheValid(const std::string& path, const std::string& key, const TextureLayout& layout)
+{
+    FILE* file = openEntry(path, key, layout);
+    if (!file)
+        return false;
+    std::fseek(file, 0, SEEK_END);
+    long end = std::ftell(file);
+    std::fclose(file);
+    return end == (long)(sizeof(CacheHeader) + key.size() + layout.dataSize());
+}
+
+bool readTextureCache(const std::string& path, const std::string& key, const TextureLayout& layout,
+                      unsigned char* dst)
+{
+    FILE* file = openEntry(path, key, layout);
+    if (!file)
+        return false;
+    bool ok = std::fread(dst, 1, layout.dataSize(), file) == layout.dataSize();
+    std::fclose(file);
+    return ok;
+}
+
+bool writeTextureCache(const std::string& path, const std::string& key, const TextureLayout& layout,
+                       const unsigned char* data)
+{
+    // write to a temporary name so a crash never leaves a truncated entry
+    std::string partial = path + ".tmp";
+    FILE* file = std::fopen(partial.c_str(), "wb");
+    if (!file) {
+        std::cout << "Failed to write texture cache " << path << std::endl;
+        return false;
+    }
+    CacheHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.format = layout.format;
+    header.width = layout.width;
+    header.height = layout.height;
+    header.levels = layout.levels;
+    header.faces = layout.faces;
+    header.keyLength = (unsigned)key.size();
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(key.data(), 1, key.size(), file) == key.size() &&
+              std::fwrite(data, 1, layout.dataSize(), file) == layout.dataSize();
+    ok = std::fclose(file) == 0 && ok;
+    std::error_code error;
+    if (ok)
+        std::filesystem::rename(partial, path, error);
+    if (!ok || error) {
+        std::filesystem::remove(partial, error);
+        std::cout << "Failed to write texture cache " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "texture_layout.hpp"
+
+#include <string>
+#include <vector>
+
+// On-disk cache of textures compressed at load time, one file per texture
+// under cache/. An entry holds a header with the texture's layout and a key
+// naming the sources it was built from (see textureCacheKey()), then its
+// packed images. A changed source or compressor misses and rebuilds.
+
+// Path of the cache file `name`, creating cache/ if needed.
+std::string textureCachePath(const std::string& name);
+// Size and modification time of every source, plus the compressor version.
+std::string textureCacheKey(const std::vector<std::string>& sources);
+
+// True if `path` holds `key` with exactly this layout.
+bool textureCacheValid(const std::string& path, const std::string& key, const TextureLayout& layout);
+// Reads the images of a valid entry into `dst` (layout.dataSize() bytes).
+bool readTextureCache(const std::string& path, const std::string& key, const TextureLayout& layout,
+                      unsigned char* dst);
+bool writeTextureCache(const std::string& path, const std::string& key, const TextureLayout& layout,
+                       const unsigned char* data);
@@ -0,0 +1,195 @@
+#include "texture_codec.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// LSB-first bit packing into a zeroed block.
+struct BlockWriter {
+    unsigned char* out;
+    int bit = 0;
+
+    void put(unsigned value, int bits)
+    {
+        for (int i = 0; i < bits; i++, bit++)
+            if (value >> i & 1)
+                out[bit >> 3] |= (unsigned char)(1 << (bit & 7));
+    }
+};
+
+// Closest 7-bit endpoint with p-bit `p` to an 8-bit colour; returns the
+// squared error.
+static int quantizeEndpoint(const float c[3], int p, int q[3])
+{
+    int error = 0;
+    for (int k = 0; k < 3; k++) {
+        q[k] = std::clamp((int)std::lround((c[k] - p) * 0.5f), 0, 127);
+        int d = (q[k] << 1 | p) - (int)std::lround(c[k]);
+        error += d * d;
+    }
+    return error;
+}
+
+static void encodeBC7Block(const float px[16][3], unsigned char* out)
+{
+    // principal axis of the block's colours by power iteration
+    float mean[3] = {};
+    for (int i = 0; i < 16; i++)
+        for (int k = 0; k < 3; k++)
+            mean[k] += px[i][k] / 16.0f;
+    float cov[6] = {};
+    for (int i = 0; i < 16; i++) {
+        float d[3] = { px[i][0] - mean[0], px[i][1] - mean[1], px[i][2] - mean[2] };
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int it = 0; it < 4; it++) {
+        float next[3] = {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+        };
+        float len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (len < 1e-6f)
+            break;
+        for (int k = 0; k < 3; k++)
+            axis[k] = next[k] / len;
+    }
+
+    float tMin = 0.0f, tMax = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float t = (px[i][0] - mean[0]) * axis[0] + (px[i][1] - mean[1]) * axis[1] + (px[i][2] - mean[2]) * axis[2];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    float ends[2][3];
+    for (int k = 0; k < 3; k++) {
+        ends[0][k] = std::clamp(mean[k] + axis[k] * tMin, 0.0f, 255.0f);
+        ends[1][k] = std::clamp(mean[k] + axis[k] * tMax, 0.0f, 255.0f);
+    }
+
+    // each endpoint takes whichever p-bit rounds it closer
+    int q[2][3], p[2];
+    for (int e = 0; e < 2; e++) {
+        int q1[3];
+        int error0 = quantizeEndpoint(ends[e], 0, q[e]);
+        int error1 = quantizeEndpoint(ends[e], 1, q1);
+        p[e] = error1 < error0 ? 1 : 0;
+        if (p[e])
+            std::memcpy(q[e], q1, sizeof(q1));
+    }
+
+    int palette[16][3];
+    for (int i = 0; i < 16; i++)
+        for (int k = 0; k < 3; k++) {
+            int e0 = q[0][k] << 1 | p[0], e1 = q[1][k] << 1 | p[1];
+            palette[i][k] = ((64 - BC7_WEIGHTS4[i]) * e0 + BC7_WEIGHTS4[i] * e1 + 32) >> 6;
+        }
+    int indices[16];
+    for (int i = 0; i < 16; i++) {
+        float best = 1e30f;
+        for (int j = 0; j < 16; j++) {
+            float d0 = px[i][0] - palette[j][0], d1 = px[i][1] - palette[j][1], d2 = px[i][2] - palette[j][2];
+            float d = d0 * d0 + d1 * d1 + d2 * d2;
+            if (d < best) {
+                best = d;
+                indices[i] = j;
+            }
+        }
+    }
+
+    // texel 0's index drops its top bit, so it must be below 8
+    if (indices[0] & 8) {
+        std::swap(q[0], q[1]);
+        std::swap(p[0], p[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    std::memset(out, 0, BC7_BLOCK_BYTES);
+    BlockWriter w{ out };
+    w.put(1 << 6, 7); // mode 6
+    for (int k = 0; k < 3; k++) {
+        w.put(q[0][k], 7);
+        w.put(q[1][k], 7);
+    }
+    w.put(127, 7); // alpha
+    w.put(127, 7);
+    w.put(p[0], 1);
+    w.put(p[1], 1);
+    w.put(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        w.put(indices[i], 4);
+}
+
+void compressBC7Rows(const unsigned char* src, int width, int height, int channels,
+                     int by0, int by1, unsigned char* dst)
+{
+    int blocksWide = (width + BC_BLOCK - 1) / BC_BLOCK;
+    float px[16][3];
+    for (int by = by0; by < by1; by++) {
+        for (int bx = 0; bx < blocksWide; bx++) {
+            for (int i = 0; i < 16; i++) {
+                int x = std::min(bx * BC_BLOCK + (i & 3), width - 1);
+                int y = std::min(by * BC_BLOCK + (i >> 2), height - 1);
+                const unsigned char* texel = src + ((size_t)y * width + x) * channels;
+                for (int k = 0; k < 3; k++)
+                    px[i][k] = texel[k];
+            }
+            encodeBC7Block(px, dst + ((size_t)by * blocksWide + bx) * BC7_BLOCK_BYTES);
+        }
+    }
+}
+
+// One signed BC4 block: the block's extremes as endpoints, eight-value mode.
+static void encodeBC4SignedBlock(const int values[16], unsigned char* out)
+{
+    int lo = 127, hi = -127;
+    for (int i = 0; i < 16; i++) {
+        lo = std::min(lo, values[i]);
+        hi = std::max(hi, values[i]);
+    }
+    float palette[8];
+    palette[0] = (float)hi;
+    palette[1] = (float)lo;
+    for (int i = 2; i < 8; i++)
+        palette[i] = ((8 - i) * hi + (i - 1) * lo) / 7.0f;
+
+    std::memset(out, 0, 8);
+    out[0] = (unsigned char)(signed char)hi;
+    out[1] = (unsigned char)(signed char)lo;
+    BlockWriter w{ out, 16 };
+    for (int i = 0; i < 16; i++) {
+        int index = 0;
+        for (int j = 1; j < 8; j++)
+            if (std::fabs(values[i] - palette[j]) < std::fabs(values[i] - palette[index]))
+                index = j;
+        // with hi == lo the block decodes in six-value mode, where 0 is still hi
+        w.put(hi == lo ? 0 : index, 3);
+    }
+}
+
+void compressBC5SignedRows(const signed char* src, int width, int height,
+                           int by0, int by1, unsigned char* dst)
+{
+    int blocksWide = (width + BC_BLOCK - 1) / BC_BLOCK;
+    int red[16], green[16];
+    for (int by = by0; by < by1; by++) {
+        for (int bx = 0; bx < blocksWide; bx++) {
+            for (int i = 0; i < 16; i++) {
+                int x = std::min(bx * BC_BLOCK + (i & 3), width - 1);
+                int y = std::min(by * BC_BLOCK + (i >> 2), height - 1);
+                const signed char* texel = src + ((size_t)y * width + x) * 2;
+                // -128 and -127 both mean -1
+                red[i] = std::max((int)texel[0], -127);
+                green[i] = std::max((int)texel[1], -127);
+            }
+            unsigned char* block = dst + ((size_t)by * blocksWide + bx) * BC5_BLOCK_BYTES;
+            encodeBC4SignedBlock(red, block);
+            encodeBC4SignedBlock(green, block + 8);
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+// Block compressors for textures baked at load time. Both work on 4x4
+// blocks; edge blocks of sizes that are not a multiple of 4 repeat the last
+// row/column. The *Rows functions encode block rows [by0, by1) of an image
+// into `dst`, the start of that image's blocks, so callers can split an
+// image across jobs.
+//
+// BC7 only uses mode 6 (one RGBA subset, 7-bit endpoints with a shared
+// p-bit, 4-bit indices): endpoints along the principal axis of the block's
+// colours, nearest palette entry per texel. Alpha is written opaque.
+
+const int BC_BLOCK = 4;
+const int BC7_BLOCK_BYTES = 16;
+const int BC5_BLOCK_BYTES = 16;
+
+// 8-bit texels with `channels` (>= 3) each, RGB used.
+void compressBC7Rows(const unsigned char* src, int width, int height, int channels,
+                     int by0, int by1, unsigned char* dst);
+
+// Two snorm8 channels per texel (like the baked normal map), as signed
+// RGTC2 / BC5.
+void compressBC5SignedRows(const signed char* src, int width, int height,
+                           int by0, int by1, unsigned char* dst);
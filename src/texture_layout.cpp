@@ -0,0 +1,107 @@
+#include "texture_layout.hpp"
+
+#include "texture_codec.hpp"
+
+#include <glad/glad.h>
+
+size_t TextureLayout::imageSize(unsigned level) const
+{
+    return textureImageSize(format, levelWidth(level), levelHeight(level));
+}
+
+size_t TextureLayout::imageOffset(unsigned level, unsigned face) const
+{
+    size_t offset = 0;
+    for (unsigned l = 0; l < level; l++)
+        offset += imageSize(l) * faces;
+    return offset + imageSize(level) * face;
+}
+
+size_t TextureLayout::dataSize() const
+{
+    return imageOffset(levels, 0);
+}
+
+// Client format and type of the uncompressed formats, as uploaded.
+static bool pixelTransfer(unsigned int format, GLenum& client, GLenum& type, int& bytes)
+{
+    switch (format) {
+    case GL_R16:
+        client = GL_RED, type = GL_UNSIGNED_SHORT, bytes = 2;
+        return true;
+    case GL_RG16:
+        client = GL_RG, type = GL_UNSIGNED_SHORT, bytes = 4;
+        return true;
+    case GL_R32F:
+        client = GL_RED, type = GL_FLOAT, bytes = 4;
+        return true;
+    case GL_RGB8:
+        client = GL_RGB, type = GL_UNSIGNED_BYTE, bytes = 3;
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t textureImageSize(unsigned int format, int width, int height)
+{
+    GLenum client, type;
+    int bytes;
+    if (pixelTransfer(format, client, type, bytes))
+        return (size_t)width * height * bytes;
+    size_t blocks = (size_t)((width + BC_BLOCK - 1) / BC_BLOCK) * ((height + BC_BLOCK - 1) / BC_BLOCK);
+    switch (format) {
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        return blocks * BC7_BLOCK_BYTES;
+    case GL_COMPRESSED_SIGNED_RG_RGTC2:
+        return blocks * BC5_BLOCK_BYTES;
+    default:
+        return 0;
+    }
+}
+
+unsigned mipCount(int width, int height)
+{
+    unsigned levels = 1;
+    while (width > 1 || height > 1) {
+        width /= 2;
+        height /= 2;
+        levels++;
+    }
+    return levels;
+}
+
+unsigned int uploadTexture(const TextureLayout& layout, const unsigned char* data, bool filtered)
+{
+    GLenum target = layout.faces == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+    GLenum client, type;
+    int bytes;
+    bool compressed = !pixelTransfer(layout.format, client, type, bytes);
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+    glTexStorage2D(target, layout.levels, layout.format, layout.width, layout.height);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned l = 0; l < layout.levels; l++)
+        for (unsigned f = 0; f < layout.faces; f++) {
+            GLenum image = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + f : GL_TEXTURE_2D;
+            const unsigned char* pixels = data + layout.imageOffset(l, f);
+            if (compressed)
+                glCompressedTexSubImage2D(image, l, 0, 0, layout.levelWidth(l), layout.levelHeight(l),
+                                          layout.format, (GLsizei)layout.imageSize(l), pixels);
+            else
+                glTexSubImage2D(image, l, 0, 0, layout.levelWidth(l), layout.levelHeight(l), client, type, pixels);
+        }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    bool mipmapped = layout.levels > 1;
+    GLint minFilter = filtered ? (mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR)
+                               : (mipmapped ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, filtered ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    return texture;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+// Format, size and mip/face layout of a texture whose images are packed
+// back to back, level-major and face-minor: how the texture cache and
+// terrain assets store textures and how uploadTexture() takes them. Mip
+// sizes follow GL (halved, rounded down, at least 1).
+struct TextureLayout {
+  unsigned int format = 0; // sized internal format: GL_R16, GL_COMPRESSED_*, ...
+  int width = 0, height = 0;
+  unsigned levels = 1, faces = 1;
+
+  int levelWidth(unsigned level) const { return width >> level > 0 ? width >> level : 1; }
+  int levelHeight(unsigned level) const { return height >> level > 0 ? height >> level : 1; }
+  size_t imageSize(unsigned level) const;
+  size_t imageOffset(unsigned level, unsigned face) const;
+  size_t dataSize() const;
+};
+
+// Bytes of one width x height image of `format`, 0 for formats nothing here
+// stores.
+size_t textureImageSize(unsigned int format, int width, int height);
+
+// Levels of a full mip chain down to 1x1.
+unsigned mipCount(int width, int height);
+
+// 2D (faces == 1) or cube map (faces == 6) texture holding every image of
+// `data`, left bound to the active unit. `filtered` picks linear filtering
+// (trilinear with mips), otherwise nearest; edges are clamped.
+unsigned int uploadTexture(const TextureLayout& layout, const unsigned char* data, bool filtered = true);
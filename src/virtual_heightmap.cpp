@@ -0,0 +1,544 @@
+#include "virtual_heightmap.hpp"
+
+#include "height_pyramid.hpp"
+#include "terrain_data.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char* TERRAIN_HEIGHT_GLSL = R"(
+uniform sampler2D heightMap;
+uniform bool virtualHeights;
+uniform usampler2D tilePages;     // per level-0 tile: cache layer (0xffff: none), level, tile x, y
+uniform sampler2DArray tileCache;
+uniform ivec2 virtualSize;        // level-0 texels
+uniform int tileTexels;
+
+float terrainHeight(vec2 uv)
+{
+  if (virtualHeights) {
+    ivec2 page = clamp(ivec2(uv * vec2(virtualSize)) / tileTexels, ivec2(0), textureSize(tilePages, 0) - 1);
+    uvec4 entry = texelFetch(tilePages, page, 0);
+    if (entry.x != 0xffffu) {
+      // texel position inside the tile; the border covers the rounding of
+      // odd level sizes
+      vec2 p = uv * vec2(max(virtualSize >> int(entry.y), ivec2(1))) - vec2(entry.zw) * float(tileTexels);
+      p = clamp(p, vec2(-0.5), vec2(tileTexels) + 0.5);
+      return textureLod(tileCache, vec3((p + 1.0) / float(tileTexels + 2), float(entry.x)), 0.0).r;
+    }
+  }
+  return textureLod(heightMap, uv, 0.0).r;
+}
+)";
+
+static const char TILE_MAGIC[8] = { 'A', 'I', 'N', 'C', 'T', 'I', 'L', 'E' };
+// bump on any change to the header or the tile layout
+static const uint32_t TILE_VERSION = 1;
+static const size_t TILE_DATA_OFFSET = 4096;
+static const int TILE_STRIDE = VIRTUAL_TILE + 2;
+static const size_t TILE_BYTES = (size_t)TILE_STRIDE * TILE_STRIDE * sizeof(unsigned short);
+static const uint16_t NO_TILE = 0xffff;
+
+struct TileHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t width, height; // level 0
+  uint32_t tileTexels;
+  uint32_t levels;       // tile levels; the overview is the next one
+};
+
+static int levelSize(int size, unsigned level)
+{
+    return std::max(1, size >> level);
+}
+
+static int tileCount(int size, unsigned level)
+{
+    return (levelSize(size, level) + VIRTUAL_TILE - 1) / VIRTUAL_TILE;
+}
+
+// First tile of every level, plus the total at the end.
+static std::vector<int> levelStarts(int width, int height, unsigned levels)
+{
+    std::vector<int> start(levels + 1, 0);
+    for (unsigned l = 0; l < levels; l++)
+        start[l + 1] = start[l] + tileCount(width, l) * tileCount(height, l);
+    return start;
+}
+
+// Reads texels of a tile pyramid; level 0 comes from the source heightmap
+// when there is one, every other level from its tiles.
+struct TileLevels {
+  const unsigned short* source = nullptr;
+  const unsigned char* tiles = nullptr; // TILE_DATA_OFFSET in
+  int width = 0, height = 0;
+  std::vector<int> start;
+
+  // a texel of a level already in place, clamped to the level
+  unsigned short stored(unsigned level, int x, int y) const
+  {
+      x = std::clamp(x, 0, levelSize(width, level) - 1);
+      y = std::clamp(y, 0, levelSize(height, level) - 1);
+      if (level == 0 && source)
+          return source[(size_t)y * width + x];
+      size_t tile = start[level] + (size_t)(y / VIRTUAL_TILE) * tileCount(width, level) + x / VIRTUAL_TILE;
+      const unsigned short* texels = (const unsigned short*)(tiles + tile * TILE_BYTES);
+      return texels[(y % VIRTUAL_TILE + 1) * TILE_STRIDE + x % VIRTUAL_TILE + 1];
+  }
+
+  // a texel of `level` from the one below, like glGenerateMipmap
+  unsigned short reduced(unsigned level, int x, int y) const
+  {
+      if (level == 0)
+          return stored(0, x, y);
+      return (unsigned short)((stored(level - 1, 2 * x, 2 * y) + stored(level - 1, 2 * x + 1, 2 * y) +
+                               stored(level - 1, 2 * x, 2 * y + 1) + stored(level - 1, 2 * x + 1, 2 * y + 1) + 2) / 4);
+  }
+
+  void overview(unsigned level, std::vector<unsigned short>& heights) const
+  {
+      int w = levelSize(width, level), h = levelSize(height, level);
+      heights.resize((size_t)w * h);
+      for (int y = 0; y < h; y++)
+          for (int x = 0; x < w; x++)
+              heights[(size_t)y * w + x] = reduced(level, x, y);
+  }
+};
+
+bool bakeVirtualHeightmap(const char* path, const std::string& outPath, int overviewTexels, JobSystem& jobs,
+                          std::vector<unsigned short>& overview, int& overviewWidth, int& overviewHeight,
+                          int& sourceBits)
+{
+    int w, h;
+    if (!heightmapSize(path, w, h)) {
+        std::cout << "Failed to load heightmap " << path << std::endl;
+        return false;
+    }
+    unsigned levels = 1;
+    while (std::max(levelSize(w, levels), levelSize(h, levels)) > std::max(overviewTexels, 1))
+        levels++;
+
+    // raw sources are mapped, so only the pages being tiled need memory
+    TileLevels levelsIn;
+    levelsIn.width = w;
+    levelsIn.height = h;
+    levelsIn.start = levelStarts(w, h, levels);
+    std::vector<unsigned short> decoded;
+    void* sourceMapping = nullptr;
+    size_t sourceSize = (size_t)w * h * sizeof(unsigned short);
+    if (isRawHeightmap(path)) {
+        int fd = ::open(path, O_RDONLY);
+        sourceMapping = fd < 0 ? MAP_FAILED : mmap(nullptr, sourceSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (fd >= 0)
+            ::close(fd);
+        if (sourceMapping == MAP_FAILED) {
+            std::cout << "Failed to load heightmap " << path << std::endl;
+            return false;
+        }
+        madvise(sourceMapping, sourceSize, MADV_SEQUENTIAL);
+        levelsIn.source = (const unsigned short*)sourceMapping;
+        sourceBits = 16;
+    }
+    else {
+        if (!decodeHeightmap(path, w, h, 0, decoded, sourceBits)) {
+            std::cout << "Failed to load heightmap " << path << std::endl;
+            return false;
+        }
+        levelsIn.source = decoded.data();
+    }
+
+    // written in place through a shared mapping, then renamed into place
+    std::string tmpPath = outPath + ".tmp";
+    size_t fileSize = TILE_DATA_OFFSET + (size_t)levelsIn.start[levels] * TILE_BYTES;
+    int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    void* out = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, (off_t)fileSize) == 0)
+        out = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd >= 0)
+        ::close(fd);
+    if (out == MAP_FAILED) {
+        std::cout << "Failed to write virtual heightmap " << outPath << std::endl;
+        if (sourceMapping)
+            munmap(sourceMapping, sourceSize);
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    TileHeader header = {};
+    std::memcpy(header.magic, TILE_MAGIC, sizeof(TILE_MAGIC));
+    header.version = TILE_VERSION;
+    header.width = w;
+    header.height = h;
+    header.tileTexels = VIRTUAL_TILE;
+    header.levels = levels;
+    std::memcpy(out, &header, sizeof(header));
+    unsigned char* tiles = (unsigned char*)out + TILE_DATA_OFFSET;
+    levelsIn.tiles = tiles;
+
+    // one job per row of tiles; a level waits for the whole level below
+    std::vector<JobHandle> below;
+    for (unsigned l = 0; l < levels; l++) {
+        int columns = tileCount(w, l), lw = levelSize(w, l), lh = levelSize(h, l);
+        below = jobs.parallelFor(0, tileCount(h, l), 1, [&levelsIn, tiles, l, columns, lw, lh](int ty0, int ty1) {
+            for (int ty = ty0; ty < ty1; ty++) {
+                for (int tx = 0; tx < columns; tx++) {
+                    unsigned short* texels = (unsigned short*)(tiles + (levelsIn.start[l] + (size_t)ty * columns + tx) * TILE_BYTES);
+                    for (int j = 0; j < TILE_STRIDE; j++) {
+                        int y = std::clamp(ty * VIRTUAL_TILE + j - 1, 0, lh - 1);
+                        for (int i = 0; i < TILE_STRIDE; i++) {
+                            int x = std::clamp(tx * VIRTUAL_TILE + i - 1, 0, lw - 1);
+                            texels[j * TILE_STRIDE + i] = levelsIn.reduced(l, x, y);
+                        }
+                    }
+                }
+            }
+        }, below, "tiles");
+    }
+    jobs.wait(jobs.submit([&levelsIn, &overview, levels]() {
+        levelsIn.overview(levels, overview);
+    }, below, "overview"));
+    overviewWidth = levelSize(w, levels);
+    overviewHeight = levelSize(h, levels);
+
+    bool ok = munmap(out, fileSize) == 0;
+    if (sourceMapping)
+        munmap(sourceMapping, sourceSize);
+    std::error_code error;
+    if (ok)
+        std::filesystem::rename(tmpPath, outPath, error);
+    if (!ok || error) {
+        std::cout << "Failed to write virtual heightmap " << outPath << std::endl;
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+int VirtualHeightmap::tilesX(unsigned level) const
+{
+    return tileCount(mapWidth, level);
+}
+
+int VirtualHeightmap::tilesY(unsigned level) const
+{
+    return tileCount(mapHeight, level);
+}
+
+const unsigned short* VirtualHeightmap::tileData(int tile) const
+{
+    return (const unsigned short*)((const unsigned char*)mapping + TILE_DATA_OFFSET + (size_t)tile * TILE_BYTES);
+}
+
+unsigned short VirtualHeightmap::texel(unsigned level, int x, int y) const
+{
+    x = std::clamp(x, 0, levelSize(mapWidth, level) - 1);
+    y = std::clamp(y, 0, levelSize(mapHeight, level) - 1);
+    const unsigned short* texels = tileData(tileIndex(level, x / VIRTUAL_TILE, y / VIRTUAL_TILE));
+    return texels[(y % VIRTUAL_TILE + 1) * TILE_STRIDE + x % VIRTUAL_TILE + 1];
+}
+
+bool VirtualHeightmap::open(const std::string& path, unsigned cacheTiles)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "Failed to open virtual heightmap " << path << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= TILE_DATA_OFFSET) {
+        mappingSize = (size_t)info.st_size;
+        mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+            mapping = nullptr;
+    }
+    ::close(fd);
+
+    TileHeader header = {};
+    if (mapping)
+        std::memcpy(&header, mapping, sizeof(header));
+    bool ok = mapping && std::memcmp(header.magic, TILE_MAGIC, sizeof(TILE_MAGIC)) == 0 &&
+              header.version == TILE_VERSION && header.tileTexels == VIRTUAL_TILE &&
+              header.width > 0 && header.height > 0 && header.levels > 0 && header.levels < 32;
+    if (ok) {
+        mapWidth = header.width;
+        mapHeight = header.height;
+        levelCount = header.levels;
+        levelStart = levelStarts(mapWidth, mapHeight, levelCount);
+        ok = TILE_DATA_OFFSET + (size_t)levelStart[levelCount] * TILE_BYTES <= mappingSize;
+    }
+    if (!ok) {
+        std::cout << "Not a virtual heightmap (or an older version): " << path << std::endl;
+        if (mapping)
+            munmap(mapping, mappingSize);
+        mapping = nullptr;
+        return false;
+    }
+    // tiles are read in whatever order the camera asks for them
+    madvise(mapping, mappingSize, MADV_RANDOM);
+
+    int maxLayers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    cacheTiles = std::clamp(cacheTiles, 1u, (unsigned)maxLayers);
+    tiles.assign(levelStart[levelCount], TILE_ABSENT);
+    tileSlot.assign(levelStart[levelCount], -1);
+    slotTile.assign(cacheTiles, -1);
+    slotUsed.assign(cacheTiles, 0);
+
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &cache);
+    glTextureStorage3D(cache, 1, GL_R16, TILE_STRIDE, TILE_STRIDE, cacheTiles);
+    glTextureParameteri(cache, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(cache, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(cache, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(cache, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &pages);
+    glTextureStorage2D(pages, 1, GL_RGBA16UI, tilesX(0), tilesY(0));
+    glTextureParameteri(pages, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(pages, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    updatePages();
+
+    // coherent, so the read jobs' writes need no flush before the upload
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &stagingBuffer);
+    glNamedBufferStorage(stagingBuffer, STAGING * TILE_BYTES, nullptr, flags);
+    stagingData = (unsigned char*)glMapNamedBufferRange(stagingBuffer, 0, STAGING * TILE_BYTES, flags);
+    if (!stagingData) {
+        // no read job has started yet, so nothing else holds these
+        std::cout << "Failed to map the virtual heightmap's staging buffer" << std::endl;
+        glDeleteTextures(1, &cache);
+        glDeleteTextures(1, &pages);
+        glDeleteBuffers(1, &stagingBuffer);
+        cache = pages = stagingBuffer = 0;
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+        return false;
+    }
+
+    std::printf("Virtual heightmap %dx%d: %u tile levels, %d tiles, cache of %u tiles (%.1f MB)\n",
+                mapWidth, mapHeight, levelCount, levelStart[levelCount], cacheTiles,
+                cacheTiles * TILE_BYTES / 1048576.0);
+    return true;
+}
+
+void VirtualHeightmap::overview(std::vector<unsigned short>& heights, int& width, int& height) const
+{
+    TileLevels levels;
+    levels.tiles = (const unsigned char*)mapping + TILE_DATA_OFFSET;
+    levels.width = mapWidth;
+    levels.height = mapHeight;
+    levels.start = levelStart;
+    levels.overview(levelCount, heights);
+    width = levelSize(mapWidth, levelCount);
+    height = levelSize(mapHeight, levelCount);
+}
+
+void VirtualHeightmap::want(unsigned level, int tx, int ty, const glm::vec3& cameraPos)
+{
+    // world units are level-0 texels, the map centred on the origin
+    float size = (float)VIRTUAL_TILE * (float)(1u << level);
+    glm::vec3 lo(tx * size - mapWidth * 0.5f, HEIGHT_OFFSET, ty * size - mapHeight * 0.5f);
+    glm::vec3 hi(std::min(lo.x + size, mapWidth * 0.5f), HEIGHT_OFFSET + HEIGHT_SCALE,
+                 std::min(lo.z + size, mapHeight * 0.5f));
+    float distance = glm::length(cameraPos - glm::clamp(cameraPos, lo, hi));
+    if (distance >= detailRange * size)
+        return;
+
+    needed.push_back({ tileIndex(level, tx, ty), level, distance });
+    if (level == 0)
+        return;
+    for (unsigned c = 0; c < 4; c++) {
+        int cx = 2 * tx + (int)(c & 1), cy = 2 * ty + (int)(c >> 1);
+        if (cx < tilesX(level - 1) && cy < tilesY(level - 1))
+            want(level - 1, cx, cy, cameraPos);
+    }
+}
+
+bool VirtualHeightmap::reclaim(Staging& slot, bool wait)
+{
+    int state = slot.state.load(std::memory_order_acquire);
+    if (state != STAGING_UPLOADED)
+        return state == STAGING_FREE;
+    GLenum result = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                     wait ? 1000000000ull : 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+        return false;
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+    slot.state.store(STAGING_FREE, std::memory_order_relaxed);
+    return true;
+}
+
+void VirtualHeightmap::uploadReady()
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+    for (unsigned i = 0; i < STAGING; i++) {
+        Staging& slot = staging[i];
+        if (slot.state.load(std::memory_order_acquire) != STAGING_READY)
+            continue;
+        // a free layer, else the one needed longest ago; request() keeps
+        // one available for every read in flight
+        int layer = -1;
+        for (int s = 0; s < (int)slotTile.size(); s++) {
+            if (slotTile[s] < 0) {
+                layer = s;
+                break;
+            }
+            if (slotUsed[s] != frame && (layer < 0 || slotUsed[s] < slotUsed[layer]))
+                layer = s;
+        }
+        int tile = slot.tile;
+        slot.job.reset();
+        if (layer < 0) {
+            tiles[tile] = TILE_ABSENT;
+            slot.state.store(STAGING_FREE, std::memory_order_relaxed);
+            continue;
+        }
+        if (slotTile[layer] >= 0) {
+            tiles[slotTile[layer]] = TILE_ABSENT;
+            tileSlot[slotTile[layer]] = -1;
+            resident--;
+        }
+        glTextureSubImage3D(cache, 0, 0, 0, layer, TILE_STRIDE, TILE_STRIDE, 1, GL_RED, GL_UNSIGNED_SHORT,
+                            (const void*)(i * TILE_BYTES));
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.state.store(STAGING_UPLOADED, std::memory_order_relaxed);
+
+        tiles[tile] = TILE_RESIDENT;
+        tileSlot[tile] = layer;
+        slotTile[layer] = tile;
+        slotUsed[layer] = frame;
+        resident++;
+        streamed++;
+        pagesDirty = true;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void VirtualHeightmap::request(JobSystem& jobs, bool wait)
+{
+    std::vector<Needed> missing;
+    for (const Needed& n : needed)
+        if (tiles[n.tile] == TILE_ABSENT)
+            missing.push_back(n);
+    // coarse levels first, so every spot gets some detail soon
+    std::sort(missing.begin(), missing.end(), [](const Needed& a, const Needed& b) {
+        return a.level != b.level ? a.level > b.level : a.distance < b.distance;
+    });
+
+    // never read more tiles than there are layers to take them
+    int available = 0;
+    for (size_t s = 0; s < slotTile.size(); s++)
+        if (slotTile[s] < 0 || slotUsed[s] != frame)
+            available++;
+    for (const Staging& slot : staging) {
+        int state = slot.state.load(std::memory_order_relaxed);
+        if (state == STAGING_LOADING || state == STAGING_READY)
+            available--;
+    }
+
+    size_t next = 0;
+    for (unsigned i = 0; i < STAGING && next < missing.size() && available > 0; i++) {
+        Staging& slot = staging[i];
+        if (!reclaim(slot, wait))
+            continue;
+        int tile = missing[next++].tile;
+        tiles[tile] = TILE_LOADING;
+        slot.tile = tile;
+        slot.state.store(STAGING_LOADING, std::memory_order_relaxed);
+        unsigned char* dst = stagingData + i * TILE_BYTES;
+        const unsigned short* src = tileData(tile);
+        slot.job = jobs.submit([&slot, dst, src]() {
+            std::memcpy(dst, src, TILE_BYTES); // page faults land here, off the GL thread
+            slot.state.store(STAGING_READY, std::memory_order_release);
+        }, {}, "tiles");
+        available--;
+    }
+}
+
+void VirtualHeightmap::updatePages()
+{
+    if (!pagesDirty)
+        return;
+    // each level-0 tile points at its finest resident ancestor
+    int columns = tilesX(0), rows = tilesY(0);
+    std::vector<uint16_t> entries((size_t)columns * rows * 4);
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < columns; x++) {
+            uint16_t* entry = &entries[((size_t)y * columns + x) * 4];
+            entry[0] = NO_TILE;
+            entry[1] = entry[2] = entry[3] = 0;
+            for (unsigned l = 0; l < levelCount; l++) {
+                int tx = std::min(x >> l, tilesX(l) - 1), ty = std::min(y >> l, tilesY(l) - 1);
+                int layer = tileSlot[tileIndex(l, tx, ty)];
+                if (layer >= 0) {
+                    entry[0] = (uint16_t)layer;
+                    entry[1] = (uint16_t)l;
+                    entry[2] = (uint16_t)tx;
+                    entry[3] = (uint16_t)ty;
+                    break;
+                }
+            }
+        }
+    }
+    glTextureSubImage2D(pages, 0, 0, 0, columns, rows, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, entries.data());
+    pagesDirty = false;
+}
+
+void VirtualHeightmap::update(const glm::vec3& cameraPos, JobSystem& jobs, bool wait)
+{
+    if (!mapping)
+        return;
+    frame++;
+    needed.clear();
+    unsigned top = levelCount - 1;
+    for (int ty = 0; ty < tilesY(top); ty++)
+        for (int tx = 0; tx < tilesX(top); tx++)
+            want(top, tx, ty, cameraPos);
+    for (const Needed& n : needed)
+        if (tileSlot[n.tile] >= 0)
+            slotUsed[tileSlot[n.tile]] = frame;
+
+    for (;;) {
+        uploadReady();
+        request(jobs, wait);
+        if (!wait)
+            break;
+        std::vector<JobHandle> reads;
+        for (const Staging& slot : staging)
+            if (slot.state.load(std::memory_order_relaxed) == STAGING_LOADING)
+                reads.push_back(slot.job);
+        if (reads.empty())
+            break;
+        jobs.wait(jobs.after(reads));
+    }
+    updatePages();
+}
+
+void VirtualHeightmap::destroy(JobSystem& jobs)
+{
+    for (Staging& slot : staging) {
+        if (slot.job)
+            jobs.wait(slot.job);
+        slot.job.reset();
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        slot.fence = 0;
+        slot.state.store(STAGING_FREE, std::memory_order_relaxed);
+    }
+    glDeleteTextures(1, &cache);
+    glDeleteTextures(1, &pages);
+    glDeleteBuffers(1, &stagingBuffer);
+    cache = pages = stagingBuffer = 0;
+    stagingData = nullptr;
+    if (mapping)
+        munmap(mapping, mappingSize);
+    mapping = nullptr;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "job_system.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Texels per tile side in a virtual heightmap; tiles are stored with one
+// more texel of border on every side, so bilinear lookups never cross tiles.
+const int VIRTUAL_TILE = 256;
+
+// A heightmap too large to keep whole, as a pyramid of tiles. Level 0 is
+// the heightmap, every level above halves it (GL mip sizes, 2x2 box
+// filter), and each level is cut into VIRTUAL_TILE tiles. The tile levels
+// stop at the first level small enough to live on the GPU in full: that
+// overview is baked like any other heightmap (pyramid, roughness, normals)
+// and bound as heightMap, while the tiles add detail on top of it where the
+// camera is.
+//
+// Tile file: a header, then every tile level-major, row-major, as
+// (VIRTUAL_TILE + 2)^2 16-bit normalized texels, border included.
+//
+// Bakes `path` (anything decodeHeightmap() reads; raw files are mapped
+// instead of read, so they can exceed memory) into a tile file at `outPath`
+// with as many levels as it takes for the overview to fit in
+// `overviewTexels` per side, and returns the overview. The tiles are built
+// level by level as jobs on `jobs`, straight into the mapped output file.
+bool bakeVirtualHeightmap(const char* path, const std::string& outPath, int overviewTexels, JobSystem& jobs,
+                          std::vector<unsigned short>& overview, int& overviewWidth, int& overviewHeight,
+                          int& sourceBits);
+
+// Streams the tiles of a tile file into a fixed GPU tile cache: a
+// GL_R16 2D array texture with one layer per cached tile, plus a page table
+// (GL_RGBA16UI, one texel per level-0 tile) naming the finest cached tile
+// covering each spot. update() picks the tiles the camera needs, reads the
+// missing ones out of the mapped file on `jobs` into a persistently mapped
+// pixel unpack buffer and uploads finished ones, evicting the least recently
+// needed. GPU memory is the cache size whatever the map size.
+class VirtualHeightmap {
+public:
+  // Maps `path` and creates the cache (`cacheTiles` layers) and page table.
+  bool open(const std::string& path, unsigned cacheTiles);
+  // The overview the tile levels stop at, from the coarsest tiles.
+  void overview(std::vector<unsigned short>& heights, int& width, int& height) const;
+  // A texel of a tile level straight from the mapped file, clamped to the
+  // level; for CPU-side readers such as the clipmap.
+  unsigned short texel(unsigned level, int x, int y) const;
+
+  // Once per frame on the GL thread, before drawing. A tile is needed while
+  // the camera is within detailRange tile sizes of it (all of its ancestors
+  // are needed too). `wait` blocks until every needed tile is in, for
+  // benchmarks that must not depend on streaming speed.
+  void update(const glm::vec3& cameraPos, JobSystem& jobs, bool wait);
+  // Waits for reads still running, since they write to the staging buffer.
+  void destroy(JobSystem& jobs);
+
+  unsigned int cacheTexture() const { return cache; }
+  unsigned int pageTexture() const { return pages; }
+  int width() const { return mapWidth; }
+  int height() const { return mapHeight; }
+  unsigned levels() const { return levelCount; }
+  unsigned residentTiles() const { return resident; }
+  unsigned streamedTiles() const { return streamed; }
+
+  float detailRange = 1.5f;
+
+private:
+  static const unsigned STAGING = 16; // tiles in flight
+  enum TileState : unsigned char { TILE_ABSENT, TILE_LOADING, TILE_RESIDENT };
+  enum StagingState { STAGING_FREE, STAGING_LOADING, STAGING_READY, STAGING_UPLOADED };
+
+  struct Staging {
+    std::atomic<int> state{STAGING_FREE}; // StagingState, READY set by the read job
+    int tile = -1;
+    JobHandle job;
+    GLsync fence = 0; // the upload out of this slot, once UPLOADED
+  };
+  struct Needed {
+    int tile;
+    unsigned level;
+    float distance;
+  };
+
+  int tilesX(unsigned level) const;
+  int tilesY(unsigned level) const;
+  int tileIndex(unsigned level, int tx, int ty) const { return levelStart[level] + ty * tilesX(level) + tx; }
+  const unsigned short* tileData(int tile) const;
+  void want(unsigned level, int tx, int ty, const glm::vec3& cameraPos);
+  bool reclaim(Staging& staging, bool wait);
+  void uploadReady();
+  void request(JobSystem& jobs, bool wait);
+  void updatePages();
+
+  void* mapping = nullptr;
+  size_t mappingSize = 0;
+  int mapWidth = 0, mapHeight = 0;
+  unsigned levelCount = 0;
+  std::vector<int> levelStart;
+
+  std::vector<TileState> tiles;
+  std::vector<int> tileSlot;           // cache layer per tile, -1 if none
+  std::vector<unsigned> slotUsed;      // frame each layer's tile was last needed
+  std::vector<int> slotTile;           // tile per layer, -1 if free
+  std::vector<Needed> needed;          // this frame's tiles
+  Staging staging[STAGING];
+  unsigned frame = 0, resident = 0, streamed = 0;
+  bool pagesDirty = true;
+
+  unsigned int cache = 0, pages = 0;
+  unsigned int stagingBuffer = 0;
+  unsigned char* stagingData = nullptr;
+};
+
+// GLSL terrainHeight(uv): the normalized height at texture coordinate uv
+// from the finest cached tile, falling back to the heightMap overview (or
+// the whole heightmap when `virtualHeights` is false). Declares the
+// heightMap, tile cache and page table samplers and their size uniforms.
+extern const char* TERRAIN_HEIGHT_GLSL;